@@ -14,36 +14,87 @@ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
 WITH REGARD TO THIS SOFTWARE.
 */
 
-static Sint16
-envelope(NdsApu *c, Uint32 age)
+/* Starts the envelope segment containing c->age. The ARM7 has no divider, so
+the per-sample stepping below matches the ARM9's envelope() exactly while
+dividing only once per segment. */
+static void
+envelope_segment(NdsApu *c)
 {
-	if(!c->r) return 0x0888;
-	if(age < c->a) return 0x0888 * age / c->a;
-	if(age < c->d) return 0x0444 * (2 * c->d - c->a - age) / (c->d - c->a);
-	if(age < c->s) return 0x0444;
-	if(age < c->r) return 0x0444 * (c->r - age) / (c->r - c->s);
-	c->advance = 0;
-	return 0x0000;
+	Uint32 age = c->age, n, div;
+	Sint32 step;
+	if(!c->r) {
+		n = 0x0888, div = 1, step = 0;
+		c->env_end = 0;
+	} else if(age < c->a) {
+		n = 0x0888 * age, div = c->a, step = 0x0888;
+		c->env_end = c->a;
+	} else if(age < c->d) {
+		n = 0x0444 * (2 * c->d - c->a - age), div = c->d - c->a, step = -0x0444;
+		c->env_end = c->d;
+	} else if(age < c->s) {
+		n = 0x0444, div = 1, step = 0;
+		c->env_end = c->s;
+	} else if(age < c->r) {
+		n = 0x0444 * (c->r - age), div = c->r - c->s, step = -0x0444;
+		c->env_end = c->r;
+	} else {
+		/* the note is over, the phase stops moving with it */
+		c->advance = c->step = c->step_rem = 0;
+		n = 0, div = 1, step = 0;
+		c->env_end = age + 1;
+	}
+	c->env = n / div;
+	c->env_rem = n % div;
+	c->env_div = div;
+	c->env_step = step / (Sint32)div;
+	c->env_step_rem = step % (Sint32)div;
+}
+
+static inline Sint32
+envelope_next(NdsApu *c)
+{
+	Sint32 e;
+	if(c->age == c->env_end)
+		envelope_segment(c);
+	e = c->env;
+	c->env += c->env_step;
+	c->env_rem += c->env_step_rem;
+	if(c->env_rem >= c->env_div)
+		c->env++, c->env_rem -= c->env_div;
+	else if(c->env_rem < 0)
+		c->env--, c->env_rem += c->env_div;
+	c->age++;
+	return e;
 }
 
-void
-nds_apu_render(NdsApu *c, Sint16 *sample_left, Sint16 *sample_right, int samples)
+/* Adds one voice to the 32-bit accumulators; returns 0 once it is silent. */
+int
+nds_apu_render(NdsApu *c, Sint32 *sample_left, Sint32 *sample_right, int samples)
 {
 	Sint32 s, i;
-	if(!c->advance || !c->period) return;
+	if(!c->advance || !c->period) return 0;
 	for(i = 0; i < samples; i++) {
-		c->count += c->advance;
-		c->i += c->count / c->period;
-		c->count %= c->period;
+		c->i += c->step;
+		c->count += c->step_rem;
+		if(c->count >= c->period) {
+			c->count -= c->period;
+			c->i++;
+			if(c->count >= c->period) {
+				/* phase left over from a note with a longer period */
+				c->i += c->count / c->period;
+				c->count %= c->period;
+			}
+		}
 		if(c->i >= c->len) {
 			if(!c->repeat) {
 				c->advance = 0;
-				return;
+				return 0;
 			}
 			c->i %= c->len;
 		}
-		s = (Sint8)(c->addr[c->i] + 0x80) * envelope(c, c->age++);
+		s = (Sint8)(c->addr[c->i] + 0x80) * envelope_next(c);
 		*sample_left++ += s * c->volume[0] / 0x180;
 		*sample_right++ += s * c->volume[1] / 0x180;
 	}
+	return c->advance != 0;
 }
@@ -48,13 +48,102 @@ static u16 sampling_timer_freq;
 static s16 *sampling_addr;
 static u8 sampling_pos;
 static NdsApu apus[POLYPHONY];
+static u8 apus_active; // one bit per voice which may still be playing
+static NdsApuQueue *apu_queue;
+static u32 apu_buffer_start; // line clock at the previous buffer switch
+static u32 apu_line_samples; // samples per scanline, 16.16 fixed point
+static u32 apu_delay; // scanlines from a frame starting to its voices playing: a buffer and a frame
+static s32 mix_left[UXNDS_AUDIO_BUFFER_SIZE], mix_right[UXNDS_AUDIO_BUFFER_SIZE];
+
+static inline s16 clamp16(s32 v) {
+	return v > 0x7FFF ? 0x7FFF : (v < -0x8000 ? -0x8000 : v);
+}
+
+static inline void apu_peak(u32 *value, u32 *peak, u32 v) {
+	*value = v;
+	if (*peak < v) *peak = v;
+}
+
+// The shared line clock as the ARM7 sees it. VcountHandler counts the frames,
+// but it cannot run while another handler has IRQs masked, so a VBlank still
+// pending in REG_IF is counted here.
+static u32 apu_line_clock(void) {
+	u32 frames, line;
+	do {
+		line = REG_VCOUNT;
+		frames = apu_queue->frames + ((REG_IF & IRQ_VBLANK) ? 1 : 0);
+	} while (line != REG_VCOUNT);
+	return uxnds_line_clock(frames, line);
+}
+
+// Sample of the buffer starting at line due on which a voice due at line at starts.
+static inline int apu_offset(u32 at, u32 due) {
+	s32 lines = at - due;
+	if (lines <= 0) return 0;
+	if (lines >= 0x4000) return sampling_bufsize;
+	return (lines * apu_line_samples) >> 16;
+}
 
 void apu_handler() {
-	memset(sampling_addr, 0, sampling_bufsize * 2);
-	memset(sampling_addr + (sampling_bufsize * 2), 0, sampling_bufsize * 2);
+	s16 *left = sampling_addr, *right = sampling_addr + (sampling_bufsize * 2);
+	u32 now = 0, due = 0, tail = 0, head = 0;
+
+	if (apu_queue) {
+		// the buffer mixed now plays from the next switch, one buffer length away
+		now = apu_line_clock();
+		due = now + (now - apu_buffer_start);
+		apu_buffer_start = now;
+		tail = apu_queue->tail;
+		head = apu_queue->head;
+		asm volatile("" ::: "memory");
+	}
+
+	if (apus_active || tail != head) {
+		// mix every voice in 32 bits, saturating once per sample; queued voices
+		// start on the sample apu_delay lines after their frame started
+		memset(mix_left, 0, sampling_bufsize * 4);
+		memset(mix_right, 0, sampling_bufsize * 4);
+		for (int pos = 0, next; pos < sampling_bufsize; pos = next) {
+			next = sampling_bufsize;
+			for (; tail != head; tail++) {
+				u32 at = apu_queue->time[tail % NDS_APU_QUEUE_SIZE] + apu_delay;
+				int offset = apu_offset(at, due);
+				if (offset > pos) {
+					if (offset < next) next = offset;
+					break;
+				}
+				u8 id = apu_queue->instance[tail % NDS_APU_QUEUE_SIZE];
+				apus[id] = apu_queue->voice[tail % NDS_APU_QUEUE_SIZE];
+				if (apus[id].advance)
+					apus_active |= 1 << id;
+				apu_peak(&apu_queue->stats.latency, &apu_queue->stats.latency_peak,
+					((s32) (at - due) > 0 ? at : due) - apu_queue->time[tail % NDS_APU_QUEUE_SIZE]);
+			}
+			for (int i = 0; i < POLYPHONY; i++) {
+				if ((apus_active & (1 << i)) && !nds_apu_render(&apus[i], mix_left + pos, mix_right + pos, next - pos))
+					apus_active &= ~(1 << i);
+			}
+		}
+		if (apu_queue)
+			apu_queue->tail = tail;
+		for (int i = 0; i < sampling_bufsize; i++) {
+			left[i] = clamp16(mix_left[i]);
+			right[i] = clamp16(mix_right[i]);
+		}
+	} else {
+		memset(left, 0, sampling_bufsize * 2);
+		memset(right, 0, sampling_bufsize * 2);
+	}
 
-	for (int i = 0; i < 4; i++) {
-		nds_apu_render(&apus[i], sampling_addr, sampling_addr + (sampling_bufsize * 2), sampling_bufsize);
+	if (apu_queue) {
+		NdsApuStats *stats = &apu_queue->stats;
+		stats->buffers++;
+		// the next switch came while mixing: the hardware played this buffer half-written
+		if (REG_IF & IRQ_TIMER0)
+			stats->late++;
+		s32 mix_time = apu_line_clock() - now;
+		if (mix_time >= 0)
+			apu_peak(&stats->mix_time, &stats->mix_time_peak, mix_time);
 	}
 
 	if (sampling_pos) {
@@ -75,6 +164,8 @@ void fifo_handler(u32 cmd, void *unused) {
 			REG_SOUNDCNT = SOUND_ENABLE | 127;
 			sampling_freq = cmd & 0xFFFF;
 			sampling_timer_freq = (((BUS_CLOCK >> 1) + (sampling_freq >> 1)) / sampling_freq) ^ 0xFFFF;
+			apu_line_samples = ((u32) sampling_freq << 16) / NDS_LINES_PER_SECOND;
+			apu_delay = UXNDS_AUDIO_BUFFER_SIZE * NDS_LINES_PER_SECOND / sampling_freq + 263;
 			break;
 		case UXNDS_FIFO_CMD_SET_ADDR:
 			sampling_addr = (s16*) (cmd & ~UXNDS_FIFO_CMD_MASK);
@@ -98,20 +189,16 @@ void fifo_handler(u32 cmd, void *unused) {
 			TIMER_DATA(0) = sampling_timer_freq;
 			TIMER_CR(0) = TIMER_IRQ_REQ | TIMER_ENABLE | ClockDivider_1024;
 			break;
-		case UXNDS_FIFO_CMD_APU0:
-		case UXNDS_FIFO_CMD_APU1:
-		case UXNDS_FIFO_CMD_APU2:
-		case UXNDS_FIFO_CMD_APU3:
-			NdsApu *apus_remote = (NdsApu*) (cmd & ~UXNDS_FIFO_CMD_MASK);
-			int oldIME = enterCriticalSection();
-			apus[(cmd >> 28) & 0x03] = apus_remote[(cmd >> 28) & 0x03];
-			leaveCriticalSection(oldIME);
-			// fifoSendValue32(UXNDS_FIFO_CHANNEL, 0);
+		case UXNDS_FIFO_CMD_SET_QUEUE:
+			apu_queue = (NdsApuQueue*) (cmd & ~UXNDS_FIFO_CMD_MASK);
+			apu_buffer_start = apu_line_clock();
 			break;
 	}
 }
 
 void VcountHandler() {
+	if (apu_queue)
+		apu_queue->frames++;
 	inputGetAndSend();
 }
 
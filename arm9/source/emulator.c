@@ -29,10 +29,14 @@ WITH REGARD TO THIS SOFTWARE.
 DTCM_BSS
 static NdsPpu ppu;
 static NdsApu apu[POLYPHONY];
+static NdsApuQueue apu_queue;
+static u32 apu_frame_time;
+static u8 apu_pending; // voices started this frame, pushed by apu_flush
 static u32 apu_samples[(UXNDS_AUDIO_BUFFER_SIZE * 4) >> 1];
 
 Uint8 dispswap;
 Uint8 debug = 0;
+Uint32 frames_skipped = 0;
 
 static PrintConsole *mainConsole;
 #ifdef DEBUG
@@ -68,8 +72,13 @@ init(void)
 {
 	if(!nds_initppu(&ppu))
 		return error("PPU", "Init failure");
-	fifoSendValue32(UXNDS_FIFO_CHANNEL, UXNDS_FIFO_CMD_SET_RATE | SAMPLE_FREQUENCY);
+#ifdef AUDIO_LOW_POWER_RATE
+	nds_apu_set_rate(AUDIO_LOW_POWER_RATE);
+#endif
+	fifoSendValue32(UXNDS_FIFO_CHANNEL, UXNDS_FIFO_CMD_SET_RATE | nds_apu_get_rate());
 	fifoSendValue32(UXNDS_FIFO_CHANNEL, UXNDS_FIFO_CMD_SET_ADDR | ((u32) (&apu_samples)));
+	DC_FlushRange(&apu_queue, sizeof(apu_queue)); // only ever accessed through memUncached from here on
+	fifoSendValue32(UXNDS_FIFO_CHANNEL, UXNDS_FIFO_CMD_SET_QUEUE | ((u32) (&apu_queue)));
 #ifdef ENABLE_KEYBOARD
 	keyboard_init();
 #endif
@@ -94,6 +103,57 @@ screen_dei(Uint8 *d, Uint8 port)
         }
 }
 
+// Consecutive auto x+1 or auto y+1 pixel writes of the same layer and
+// color are collected here and drawn as a single fill.
+typedef struct {
+	Uint32 *layer;
+	Uint16 x, y, length;
+	Uint8 color, move;
+} PixelSpan;
+
+DTCM_BSS
+static PixelSpan pixel_span;
+
+ITCM_ARM_CODE
+static void
+screen_flush_pixels(void)
+{
+	PixelSpan *s = &pixel_span;
+	if(!s->length) return;
+	if(s->move & 0x1)
+		nds_ppu_fill(&ppu, s->layer, s->x, s->y, s->x + s->length, s->y + 1, s->color);
+	else
+		nds_ppu_fill(&ppu, s->layer, s->x, s->y, s->x + 1, s->y + s->length, s->color);
+	s->length = 0;
+}
+
+ITCM_ARM_CODE
+static void
+screen_pixel(Uint32 *layer, Uint16 x, Uint16 y, Uint8 color, Uint8 move)
+{
+	PixelSpan *s = &pixel_span;
+	if(move != 0x1 && move != 0x2) {
+		screen_flush_pixels();
+		nds_ppu_pixel(&ppu, layer, x, y, color);
+		return;
+	}
+	if(x >= PPU_PIXELS_WIDTH || y >= PPU_PIXELS_HEIGHT)
+		return;
+	if(s->length && s->layer == layer && s->color == color && s->move == move
+		&& x == s->x + (move == 0x1 ? s->length : 0)
+		&& y == s->y + (move == 0x2 ? s->length : 0)) {
+		s->length++;
+		return;
+	}
+	screen_flush_pixels();
+	s->layer = layer;
+	s->x = x;
+	s->y = y;
+	s->color = color;
+	s->move = move;
+	s->length = 1;
+}
+
 ITCM_ARM_CODE
 static void
 screen_deo(Uint8 *d, Uint8 port)
@@ -110,18 +170,19 @@ screen_deo(Uint8 *d, Uint8 port)
 			Uint16 y2 = PPU_TILES_HEIGHT * 8;
 			if(ctrl & 0x10) x2 = x, x = 0;
 			if(ctrl & 0x20) y2 = y, y = 0;
+			screen_flush_pixels();
 			nds_ppu_fill(&ppu, layer, x, y, x2, y2, color);
 		}
 		/* pixel mode */
 		else {
 			Uint16 x = peek16(d, 0x8);
 			Uint16 y = peek16(d, 0xa);
-			nds_ppu_pixel(&ppu, layer, x, y, d[0xe] & 0x3);
+			screen_pixel(layer, x, y, d[0xe] & 0x3, d[0x6] & 0x3);
 			if(d[0x6] & 0x1) POKE2(d + 0x8, x + 1); /* auto x+1 */
 			if(d[0x6] & 0x2) POKE2(d + 0xa, y + 1); /* auto y+1 */
 		}
 	} else if(port == 0xf) {
-		Uint8 twobpp = d[0xf] & 0x80;
+		Uint8 twobpp = !!(d[0xf] & 0x80);
 		Uint16 x = peek16(d, 0x8);
 		Uint16 y = peek16(d, 0xa);
 		Uint32 *layer = d[0xf] & 0x40 ? ppu.fg : ppu.bg;
@@ -133,16 +194,11 @@ screen_deo(Uint8 *d, Uint8 port)
 		int flipy = (d[0xf] & 0x20), fy = flipy ? -1 : 1;
 		Uint16 dyx = dy * fx, dxy = dx * fy;
 		Uint16 len = (n + 1) << (3 + twobpp);
+		Uint16 addr_incr = (d[0x6] & 0x04) << (1 + twobpp);
 		if(addr > (0x10000 - len)) return;
-		for (Uint8 i = 0; i <= n; i++) {
-			if (twobpp) {
-				nds_ppu_2bpp(&ppu, layer, x + dyx * i, y + dxy * i, &u.ram.dat[addr], d[0xf] & 0xf, flipx, flipy);
-				addr += (d[0x6] & 0x04) << 2;
-			} else {
-				nds_ppu_1bpp(&ppu, layer, x + dyx * i, y + dxy * i, &u.ram.dat[addr], d[0xf] & 0xf, flipx, flipy);
-				addr += (d[0x6] & 0x04) << 1;
-			}
-		}
+		screen_flush_pixels();
+		nds_ppu_sprite(&ppu, layer, x, y, dyx, dxy, &u.ram.dat[addr], addr_incr, n, d[0xf] & 0xf, flipx, flipy, twobpp);
+		addr += addr_incr * (n + 1);
                 poke16(d, 0x8, x + dx * fx); /* auto x+dx */
                 poke16(d, 0xa, y + dy * fy); /* auto y+dy */
                 poke16(d, 0xc, addr);        /* auto addr */
@@ -165,7 +221,7 @@ ITCM_ARM_CODE
 static void
 audio_deo(int instance_id, Uint8 *d, Uint8 port)
 {
-	NdsApu *instance = memUncached(&apu[instance_id]);
+	NdsApu *instance = &apu[instance_id];
 	if(port == 0xf) {
 		Uint16 addr = peek16(d, 0xc);
 		instance->len = peek16(d, 0xa);
@@ -177,13 +233,22 @@ audio_deo(int instance_id, Uint8 *d, Uint8 port)
 		instance->repeat = !(d[0xf] & 0x80);
 		Uint8 detune = d[0x5];
 		nds_apu_start(instance, peek16(d, 0x8), d[0xf] & 0x7f, detune);
-		fifoSendValue32(UXNDS_FIFO_CHANNEL, (UXNDS_FIFO_CMD_APU0 + ((instance_id) << 28))
-			| ((u32) (&apu)));
-		// fifoWaitValue32(UXNDS_FIFO_CHANNEL);
-		// fifoGetValue32(UXNDS_FIFO_CHANNEL);
+		apu_pending |= 1 << instance_id;
 	}
 }
 
+// Pushes the voices started this frame to the ARM7, only the last start of
+// each: one started again within the frame would be cut on the sample it starts.
+static void
+apu_flush(void)
+{
+	NdsApuQueue *q = memUncached(&apu_queue);
+	for(int i = 0; i < POLYPHONY; i++)
+		if(apu_pending & (1 << i))
+			nds_apu_push(q, i, &apu[i], apu_frame_time);
+	apu_pending = 0;
+}
+
 ITCM_ARM_CODE
 static Uint8 audio0_dei(Uint8 *d, Uint8 port) { return audio_dei(0, d, port); }
 ITCM_ARM_CODE
@@ -326,6 +391,43 @@ profiler_ticks(Uint32 tticks, int pos, const char *name)
 	iprintf("\x1b[%d;0H\x1b[0K%s: %d, peak %d\n", pos, name, tticks, tticks_peak[pos]);
 	consoleSelect(mainConsole);
 }
+
+void
+profiler_sprites(int pos)
+{
+	consoleSelect(&profileConsole);
+	iprintf("\x1b[%d;0H\x1b[0Kspr %d a%d c%d h%d f%d 2b%d", pos,
+		nds_ppu_stats.sprites, nds_ppu_stats.sprites_aligned, nds_ppu_stats.sprites_clipped,
+		nds_ppu_stats.sprites_hidden, nds_ppu_stats.sprites_flipped, nds_ppu_stats.sprites_2bpp);
+	consoleSelect(mainConsole);
+}
+
+void
+profiler_tiles(int pos)
+{
+	consoleSelect(&profileConsole);
+	iprintf("\x1b[%d;0H\x1b[0Ktiles: copied %d, skipped %d", pos,
+		nds_ppu_stats.tiles_copied, nds_ppu_stats.tiles_skipped);
+	consoleSelect(mainConsole);
+}
+
+void
+profiler_audio(int pos)
+{
+	NdsApuStats *stats = &((NdsApuQueue *) memUncached(&apu_queue))->stats;
+	consoleSelect(&profileConsole);
+	iprintf("\x1b[%d;0H\x1b[0Kapu x%d/%d mix %d/%d lat %d/%d", pos, stats->late, stats->dropped,
+		stats->mix_time, stats->mix_time_peak, stats->latency, stats->latency_peak);
+	consoleSelect(mainConsole);
+}
+
+void
+profiler_skipped(int pos, Uint32 skipped)
+{
+	consoleSelect(&profileConsole);
+	iprintf("\x1b[%d;0H\x1b[0Kskipped: %d, total %d", pos, skipped, frames_skipped);
+	consoleSelect(mainConsole);
+}
 #endif
 
 static int
@@ -406,6 +508,36 @@ static void vblankHandler(void)
 	vbl_counter++;
 }
 
+// ARM7 frame count minus vbl_counter. The ARM7 count can only lag behind its
+// VBlank (the handler waits out apu_handler), so the largest difference seen
+// is the true one.
+static s32 apu_frames_diff;
+static bool apu_frames_synced;
+
+// The shared line clock as the ARM9 sees it: frames come from vblankHandler,
+// which runs on time, lined up with the ARM7 count.
+static u32 apu_line_clock(void)
+{
+	NdsApuQueue *q = memUncached(&apu_queue);
+	u32 frames, shared, line;
+	int oldIME = enterCriticalSection();
+	do {
+		line = REG_VCOUNT;
+		frames = vbl_counter + ((REG_IF & IRQ_VBLANK) ? 1 : 0);
+		shared = q->frames;
+	} while (line != REG_VCOUNT);
+	leaveCriticalSection(oldIME);
+
+	if (!shared) // the ARM7 has not counted a frame yet
+		return uxnds_line_clock(0, line);
+	s32 diff = shared - frames;
+	if (!apu_frames_synced || diff > apu_frames_diff) {
+		apu_frames_diff = diff;
+		apu_frames_synced = true;
+	}
+	return uxnds_line_clock(frames + apu_frames_diff, line);
+}
+
 int
 start(Uxn *u)
 {
@@ -413,6 +545,7 @@ start(Uxn *u)
 	u32 tticks;
 #endif
 	u32 last_vbl_counter = 0;
+	u32 skip_run = 0;
 
 	irqSet(IRQ_VBLANK, vblankHandler);
 	irqEnable(IRQ_VBLANK);
@@ -420,6 +553,8 @@ start(Uxn *u)
 	uxn_eval(u, 0x0100);
 	while(1) {
 		if(u->dev[0x0f]) break; // Run ended.
+		// voices started during this frame play a fixed number of lines from now, see apu_delay on the ARM7
+		apu_frame_time = apu_line_clock();
 		scanKeys();
 #ifdef DEBUG_PROFILE
 		int allHeld = keysDown() | keysHeld();
@@ -435,6 +570,8 @@ start(Uxn *u)
 		tticks = timer_ticks(0);
 #endif
 		uxn_eval(u, GETVEC(u->dev + 0x20));
+		console_flush();
+		apu_flush();
 #ifdef DEBUG_PROFILE
 		profiler_ticks(timer_ticks(0) - tticks, 0, "main");
 #endif
@@ -448,13 +585,27 @@ start(Uxn *u)
 		if (req_wait_vblank) {
 			swiWaitForVBlank();
 			last_vbl_counter++;
+		} else if (skip_run < FRAMESKIP_MAX) {
+			// the vector overran the frame: leave the copy to a later frame
+			skip_run++;
+			frames_skipped++;
+#ifdef DEBUG_PROFILE
+			profiler_skipped(4, skip_run);
+#endif
+			continue;
 		}
+		skip_run = 0;
 #ifdef DEBUG_PROFILE
 		tticks = timer_ticks(0);
 #endif
+		screen_flush_pixels();
 		nds_copyppu(&ppu);
 #ifdef DEBUG_PROFILE
 		profiler_ticks(timer_ticks(0) - tticks, 2, "flip");
+		profiler_sprites(3);
+		profiler_tiles(5);
+		profiler_audio(6);
+		memset(&nds_ppu_stats, 0, sizeof(nds_ppu_stats));
 #endif
 	}
 
@@ -491,10 +642,10 @@ main(int argc, char **argv)
 	TIMER0_CR = TIMER_ENABLE | TIMER_DIV_1;
 	TIMER1_CR = TIMER_ENABLE | TIMER_CASCADE;
 
-	consoleSetWindow(mainConsole, 0, 0, 32, 11);
+	consoleSetWindow(mainConsole, 0, 0, 32, 8);
 
 	profileConsole = *mainConsole;
-	consoleSetWindow(&profileConsole, 0, 11, 32, 4);
+	consoleSetWindow(&profileConsole, 0, 8, 32, 7);
 #else
 	consoleSetWindow(mainConsole, 0, 0, 32, 14);
 #endif
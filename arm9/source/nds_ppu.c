@@ -36,11 +36,8 @@ WITH REGARD TO THIS SOFTWARE.
 
 DTCM_DATA
 static Uint8 blending[5][16] = {
-        {0, 0, 0, 0, 1, 0, 1, 1, 2, 2, 0, 2, 3, 3, 3, 0},
-        {0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
-        {1, 2, 3, 1, 1, 2, 3, 1, 1, 2, 3, 1, 1, 2, 3, 1},
-        {2, 3, 1, 2, 2, 3, 1, 2, 2, 3, 1, 2, 2, 3, 1, 2},
-        {0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0}};
+#include "devices/blending.inc"
+};
 
 #define PPU_TILES_WIDTH 32
 #define PPU_TILES_HEIGHT 24
@@ -48,24 +45,14 @@ static Uint8 blending[5][16] = {
 DTCM_BSS
 static Uint32 tile_dirty[PPU_TILES_HEIGHT + 1];
 
-DTCM_DATA
-static Uint32 lut_expand_8_32[256] = {
-#include "lut_expand_8_32.inc"
-};
-
-DTCM_DATA
-static Uint32 lut_expand_8_32_flipx[256] = {
-#include "lut_expand_8_32_flipx.inc"
-};
-
 DTCM_DATA
 static Uint32 lut_expand_8_32_f[256] = {
-#include "lut_expand_8_32_f.inc"
+#include "devices/lut_expand_8_32_f.inc"
 };
 
 DTCM_DATA
 static Uint32 lut_expand_8_32_f_flipx[256] = {
-#include "lut_expand_8_32_f_flipx.inc"
+#include "devices/lut_expand_8_32_f_flipx.inc"
 };
 
 /* DTCM_DATA
@@ -80,6 +67,10 @@ static Uint32 lut_mask_8_32_count[8] = {
 	0xFFFFFFFF
 }; */
 
+#ifdef DEBUG_PROFILE
+NdsPpuStats nds_ppu_stats;
+#endif
+
 DTCM_BSS
 static Uint16 pal_colors_cache[4];
 DTCM_BSS
@@ -111,8 +102,8 @@ nds_ppu_pixel(NdsPpu *p, Uint32 *layer, Uint16 x, Uint16 y, Uint8 color)
 		return;
 	Uint32 pos = ((y & 7) + ( ((x >> 3) + (y >> 3) * PPU_TILES_WIDTH) * 8) );
 	Uint32 shift = (x & 7) << 2;
-	layer[pos] = (layer[pos] & (~(0xF << shift))) | (color << shift);
-	tile_dirty[y >> 3] |= 1 << (x >> 3);
+	layer[pos] = (layer[pos] & (~(0xFu << shift))) | (color << shift);
+	tile_dirty[y >> 3] |= 1u << (x >> 3);
 }
 
 // Doesn't calculate tile_dirty by itself.
@@ -140,10 +131,10 @@ __nds_ppu_hline(Uint32 *layer, Uint16 x0, Uint16 x1, Uint32 y, Uint32 row) {
 	size_t shift_right = (7 - end_col) * 4;
 
 	if (dtx < 1) {
-		u32 mask = (0xFFFFFFFF >> shift_right) & (0xFFFFFFFF << shift_left);
+		Uint32 mask = (0xFFFFFFFF >> shift_right) & (0xFFFFFFFF << shift_left);
 		*dst = (*dst & ~mask) | (row & mask);
 	} else {
-		u32 mask = 0xFFFFFFFF;
+		Uint32 mask = 0xFFFFFFFF;
 		*dst = (*dst & ~(mask << shift_left)) | (row << shift_left);
 		dst += 8;
 		for (size_t i = 1; i < dtx; i++) {
@@ -163,11 +154,14 @@ nds_ppu_fill(NdsPpu *p, Uint32 *layer, Uint16 x1, Uint16 y1, Uint16 x2, Uint16 y
 	if (y1 > PPU_TILES_HEIGHT * 8) y1 = PPU_TILES_HEIGHT * 8;
 	if (y2 > PPU_TILES_HEIGHT * 8) y2 = PPU_TILES_HEIGHT * 8;
 
+	if (x1 >= x2 || y1 >= y2) return;
+
 	Uint32 color_full = 0x11111111 * color;
 
 	for (Uint16 y = y1; y < y2; y++) {
 #if 1
-		__nds_ppu_hline(layer, x1, x2, y, color_full);
+		// __nds_ppu_hline takes an inclusive end column
+		__nds_ppu_hline(layer, x1, x2 - 1, y, color_full);
 #else
 		Uint32 y_pos = (y & 7) + ((y >> 3) * PPU_TILES_WIDTH * 8);
 
@@ -189,7 +183,7 @@ nds_ppu_fill(NdsPpu *p, Uint32 *layer, Uint16 x1, Uint16 y1, Uint16 x2, Uint16 y
 	{
 		Uint32 dirty_line = 0;
 		for (Uint16 x = x1 >> 3; x <= (x2 - 1) >> 3; x++) {
-			dirty_line |= (1 << x);
+			dirty_line |= (1u << x);
 		}
 		for (Uint16 y = y1 >> 3; y <= (y2 - 1) >> 3; y++) {
 			tile_dirty[y] |= dirty_line;
@@ -197,183 +191,164 @@ nds_ppu_fill(NdsPpu *p, Uint32 *layer, Uint16 x1, Uint16 y1, Uint16 x2, Uint16 y
 	}
 }
 
+// Expands one sprite row into eight 4bpp pixels. ch1/ch2 are the plane bits
+// expanded to nibble masks; *mask receives the nibbles which get written.
 ITCM_ARM_CODE
-void
-nds_ppu_1bpp(NdsPpu *p, Uint32 *layer, int16_t x, int16_t y, Uint8 *sprite, Uint8 color, Uint8 flipx, Uint8 flipy)
+static inline Uint32
+__nds_ppu_sprite_row(Uint32 ch1, Uint32 ch2, Uint32 *colors, Uint32 opaque, Uint32 *mask)
 {
-	Uint8 sprline;
-	Uint8 xleftedge = x >= 0;
-	Uint8 xrightedge = x < ((PPU_TILES_WIDTH - 1) * 8);
-	Uint16 v;
-	Uint32 dirtyflag = (1 << (x >> 3)) | (1 << ((x + 7) >> 3));
-
-	Uint32 layerpos = ((y & 7) + (((x >> 3) + (y >> 3) * PPU_TILES_WIDTH) * 8));
-	Uint32 *layerptr = &layer[layerpos];
-	Uint32 shift = (x & 7) << 2;
-	Uint32 *lut_expand = flipx ? lut_expand_8_32_f : lut_expand_8_32_f_flipx;
-	Uint32 color_fg = (color & 3) * 0x11111111;
-	Uint32 color_bg = (color >> 2) * 0x11111111;
-
-	if (flipy) flipy = 7;
-
-	if(x <= -8 || y <= -8 || x >= PPU_TILES_WIDTH * 8 || y >= PPU_TILES_HEIGHT * 8)
-		return;
-
-	if (blending[4][color]) {
-		u64 mask = ~((u64)0xFFFFFFFF << shift);
-
-		for (v = 0; v < 8; v++, layerptr++) {
-			if ((y + v) < (PPU_TILES_HEIGHT * 8)) {
-				sprline = sprite[v ^ flipy];
-				u64 data = (u64)(lut_expand[sprline] & color_fg) << shift;
-				data |= (u64)(lut_expand[sprline ^ 0xFF] & color_bg) << shift;
-
-				if (xleftedge) layerptr[0] = (layerptr[0] & mask) | data;
-				if (xrightedge) layerptr[8] = (layerptr[8] & (mask >> 32)) | (data >> 32);
-			} else if (!flipy) break;
+	Uint32 both = ch1 & ch2;
+	Uint32 any = ch1 | ch2;
+	*mask = any | opaque;
+	return (colors[0] & ~any & opaque)
+		| (colors[1] & (ch1 ^ both))
+		| (colors[2] & (ch2 ^ both))
+		| (colors[3] & both);
+}
 
-			if (((y + v) & 7) == 7) layerptr += (PPU_TILES_WIDTH - 1) * 8;
-		}
-	} else {
-		for (v = 0; v < 8; v++, layerptr++) {
-			if ((y + v) < (PPU_TILES_HEIGHT * 8)) {
-				sprline = sprite[v ^ flipy];
-				u64 mask = ~((u64)(lut_expand[sprline]) << shift);
-				u64 data = (u64)(lut_expand[sprline] & color_fg) << shift;
+ITCM_ARM_CODE
+static inline Uint32
+__nds_ppu_dirty_mask(int pos, int limit)
+{
+	Uint32 mask = 0;
+	if (pos >= 0) mask |= 1u << (pos >> 3);
+	if (pos + 7 < limit) mask |= 1u << ((pos + 7) >> 3);
+	return mask;
+}
 
-				if (xleftedge) layerptr[0] = (layerptr[0] & mask) | data;
-				if (xrightedge) layerptr[8] = (layerptr[8] & (mask >> 32)) | (data >> 32);
-			} else if (!flipy) break;
+// Sprite row kernels. twobpp and opaque are passed as constants by the
+// variants below, so each one is compiled without those checks; flipx is
+// handled by the choice of lut_expand and flipy by indexing.
+ITCM_ARM_CODE
+static inline __attribute__((always_inline)) void
+__nds_ppu_sprite_aligned(Uint32 *layerptr, Uint8 *sprite, Uint32 *lut_expand, Uint32 *colors, int ty, Uint8 flipy, int twobpp, int opaque)
+{
+	for (int v = 0; v < 8; v++) {
+		Uint32 mask;
+		Uint32 ch1 = lut_expand[sprite[v ^ flipy]];
+		Uint32 ch2 = twobpp ? lut_expand[sprite[(v ^ flipy) | 8]] : 0;
+		Uint32 data = __nds_ppu_sprite_row(ch1, ch2, colors, opaque ? 0xFFFFFFFF : 0, &mask);
+		*layerptr = opaque ? data : (*layerptr & ~mask) | data;
+		layerptr += ((ty + v) & 7) == 7 ? (PPU_TILES_WIDTH - 1) * 8 + 1 : 1;
+	}
+}
 
-			if (((y + v) & 7) == 7) layerptr += (PPU_TILES_WIDTH - 1) * 8;
+ITCM_ARM_CODE
+static inline __attribute__((always_inline)) void
+__nds_ppu_sprite_clipped(Uint32 *layerptr, Uint8 *sprite, Uint32 *lut_expand, Uint32 *colors, Uint32 opaque, int tx, int ty, Uint8 flipy, int twobpp)
+{
+	Uint32 shift = (tx & 7) << 2;
+	Uint8 xleftedge = tx >= 0;
+	Uint8 xrightedge = shift && tx < PPU_PIXELS_WIDTH - 8;
+	for (int v = 0; v < 8; v++, layerptr++) {
+		if ((ty + v) >= PPU_PIXELS_HEIGHT) break;
+		if ((ty + v) >= 0) {
+			Uint32 mask32;
+			Uint32 ch1 = lut_expand[sprite[v ^ flipy]];
+			Uint32 ch2 = twobpp ? lut_expand[sprite[(v ^ flipy) | 8]] : 0;
+			Uint64 data = (Uint64) __nds_ppu_sprite_row(ch1, ch2, colors, opaque, &mask32) << shift;
+			Uint64 mask = ~((Uint64) mask32 << shift);
+
+			if (xleftedge) layerptr[0] = (layerptr[0] & mask) | data;
+			if (xrightedge) layerptr[8] = (layerptr[8] & (mask >> 32)) | (data >> 32);
 		}
+		if (((ty + v) & 7) == 7) layerptr += (PPU_TILES_WIDTH - 1) * 8;
 	}
-
-	if (y >= 0) tile_dirty[y >> 3] |= dirtyflag;
-	tile_dirty[(y + 7) >> 3] |= dirtyflag;
 }
 
+typedef void (*NdsPpuSpriteAligned)(Uint32 *layerptr, Uint8 *sprite, Uint32 *lut_expand, Uint32 *colors, int ty, Uint8 flipy);
+typedef void (*NdsPpuSpriteClipped)(Uint32 *layerptr, Uint8 *sprite, Uint32 *lut_expand, Uint32 *colors, Uint32 opaque, int tx, int ty, Uint8 flipy);
+
+#define NDS_PPU_SPRITE_ALIGNED(name, twobpp, opaque) \
+	ITCM_ARM_CODE static void name(Uint32 *layerptr, Uint8 *sprite, Uint32 *lut_expand, Uint32 *colors, int ty, Uint8 flipy) \
+	{ __nds_ppu_sprite_aligned(layerptr, sprite, lut_expand, colors, ty, flipy, twobpp, opaque); }
+#define NDS_PPU_SPRITE_CLIPPED(name, twobpp) \
+	ITCM_ARM_CODE static void name(Uint32 *layerptr, Uint8 *sprite, Uint32 *lut_expand, Uint32 *colors, Uint32 opaque, int tx, int ty, Uint8 flipy) \
+	{ __nds_ppu_sprite_clipped(layerptr, sprite, lut_expand, colors, opaque, tx, ty, flipy, twobpp); }
+
+NDS_PPU_SPRITE_ALIGNED(__nds_ppu_1bpp_aligned, 0, 0)
+NDS_PPU_SPRITE_ALIGNED(__nds_ppu_1bpp_aligned_opaque, 0, 1)
+NDS_PPU_SPRITE_ALIGNED(__nds_ppu_2bpp_aligned, 1, 0)
+NDS_PPU_SPRITE_ALIGNED(__nds_ppu_2bpp_aligned_opaque, 1, 1)
+NDS_PPU_SPRITE_CLIPPED(__nds_ppu_1bpp_clipped, 0)
+NDS_PPU_SPRITE_CLIPPED(__nds_ppu_2bpp_clipped, 1)
+
+// [twobpp][opaque]
+static const NdsPpuSpriteAligned nds_ppu_sprite_aligned[2][2] = {
+	{ __nds_ppu_1bpp_aligned, __nds_ppu_1bpp_aligned_opaque },
+	{ __nds_ppu_2bpp_aligned, __nds_ppu_2bpp_aligned_opaque }
+};
+// [twobpp]
+static const NdsPpuSpriteClipped nds_ppu_sprite_clipped[2] = {
+	__nds_ppu_1bpp_clipped, __nds_ppu_2bpp_clipped
+};
+
+// Draws count + 1 sprites, each one (dx, dy) away from the previous one, as
+// used by the auto length mode of the sprite port. Horizontal and vertical
+// strips mark their tiles dirty in a single pass once drawing is done.
 ITCM_ARM_CODE
 void
-nds_ppu_2bpp(NdsPpu *p, Uint32 *layer, int16_t x, int16_t y, Uint8 *sprite, Uint8 color, Uint8 flipx, Uint8 flipy)
+nds_ppu_sprite(NdsPpu *p, Uint32 *layer, Uint16 x, Uint16 y, Uint16 dx, Uint16 dy, Uint8 *sprite, Uint16 sprite_step, Uint8 count, Uint8 color, Uint8 flipx, Uint8 flipy, Uint8 twobpp)
 {
-	Uint8 sprline1, sprline2;
-	Uint8 xleftedge = x >= 0;
-	Uint8 xrightedge = x < ((PPU_TILES_WIDTH - 1) * 8);
-	Uint16 v, h;
-	Uint32 dirtyflag = (1 << (x >> 3)) | (1 << ((x + 7) >> 3));
-
-	Uint32 layerpos = ((y & 7) + (((x >> 3) + (y >> 3) * PPU_TILES_WIDTH) * 8));
-	Uint32 *layerptr = &layer[layerpos];
-	Uint32 shift = (x & 7) << 2;
+	Uint32 *lut_expand = flipx ? lut_expand_8_32_f : lut_expand_8_32_f_flipx;
+	Uint32 opaque = blending[4][color] ? 0xFFFFFFFF : 0;
+	Uint32 colors[4];
+	Uint32 dirty_cols = 0, dirty_rows = 0;
+	Uint8 strip = !dx || !dy;
+	NdsPpuSpriteAligned aligned = nds_ppu_sprite_aligned[twobpp ? 1 : 0][opaque ? 1 : 0];
+	NdsPpuSpriteClipped clipped = nds_ppu_sprite_clipped[twobpp ? 1 : 0];
+	int i;
 
+	for (i = 0; i < 4; i++)
+		colors[i] = blending[i][color] * 0x11111111;
 	if (flipy) flipy = 7;
 
-	if(x <= -8 || y <= -8 || x >= PPU_TILES_WIDTH * 8 || y >= PPU_TILES_HEIGHT * 8)
-		return;
-
-	if (color == 1) {
-		Uint32 *lut_expand = flipx ? lut_expand_8_32 : lut_expand_8_32_flipx;
-		u64 mask = ~((u64)0xFFFFFFFF << shift);
-
-		for (v = 0; v < 8; v++, layerptr++) {
-			if ((y + v) < (PPU_TILES_HEIGHT * 8)) {
-				sprline1 = sprite[v ^ flipy];
-				sprline2 = sprite[(v ^ flipy) | 8];
-
-				u32 data32 = (lut_expand[sprline1]) | ((lut_expand[sprline2]) << 1);
-				u64 data = ((u64) (data32)) << shift;
-
-				if (xleftedge) layerptr[0] = (layerptr[0] & mask) | data;
-				if (xrightedge) layerptr[8] = (layerptr[8] & (mask >> 32)) | (data >> 32);
-			} else if (!flipy) break;
+#ifdef DEBUG_PROFILE
+	nds_ppu_stats.sprites += count + 1;
+	if (twobpp) nds_ppu_stats.sprites_2bpp += count + 1;
+	if (flipx || flipy) nds_ppu_stats.sprites_flipped += count + 1;
+#endif
 
-			if (((y + v) & 7) == 7) layerptr += (PPU_TILES_WIDTH - 1) * 8;
+	for (i = 0; i <= count; i++, x += dx, y += dy, sprite += sprite_step) {
+		int tx = (int16_t) x;
+		int ty = (int16_t) y;
+		if (tx <= -8 || ty <= -8 || tx >= PPU_PIXELS_WIDTH || ty >= PPU_PIXELS_HEIGHT) {
+#ifdef DEBUG_PROFILE
+			nds_ppu_stats.sprites_hidden++;
+#endif
+			continue;
 		}
-	} else if (blending[4][color]) {
-		u64 mask = ~((u64)0xFFFFFFFF << shift);
-
-		for (v = 0; v < 8; v++, layerptr++) {
-			if ((y + v) < (PPU_TILES_HEIGHT * 8)) {
-				Uint8 ch1 = sprite[v ^ flipy];
-				Uint8 ch2 = sprite[(v ^ flipy) | 8];
-				u32 data32 = 0;
 
-				if (!flipx) {
-					for (h = 0; h < 8; h++) {
-						data32 <<= 4;
+		Uint32 *layerptr = &layer[(ty & 7) + (((tx >> 3) + (ty >> 3) * PPU_TILES_WIDTH) * 8)];
 
-						Uint8 ch = (ch1 & 1) | ((ch2 & 1) << 1);
-						data32 |= blending[ch][color];
-
-						ch1 >>= 1; ch2 >>= 1;
-					}
-				} else {
-					for (h = 0; h < 8; h++) {
-						data32 <<= 4;
-
-						Uint8 ch = (ch1 >> 7) | ((ch2 >> 7) << 1);
-						data32 |= blending[ch][color];
-
-						ch1 <<= 1; ch2 <<= 1;
-					}
-				}
-
-				u64 data = ((u64) (data32)) << shift;
-
-				if (xleftedge) layerptr[0] = (layerptr[0] & mask) | data;
-				if (xrightedge) layerptr[8] = (layerptr[8] & (mask >> 32)) | (data >> 32);
-			} else if (!flipy) break;
-
-			if (((y + v) & 7) == 7) layerptr += (PPU_TILES_WIDTH - 1) * 8;
+		if (!(tx & 7) && ty >= 0 && ty <= PPU_PIXELS_HEIGHT - 8) {
+			// 8-pixel aligned and fully visible: whole-word stores.
+#ifdef DEBUG_PROFILE
+			nds_ppu_stats.sprites_aligned++;
+#endif
+			aligned(layerptr, sprite, lut_expand, colors, ty, flipy);
+		} else {
+#ifdef DEBUG_PROFILE
+			if (tx < 0 || tx > PPU_PIXELS_WIDTH - 8 || ty < 0 || ty > PPU_PIXELS_HEIGHT - 8)
+				nds_ppu_stats.sprites_clipped++;
+#endif
+			clipped(layerptr, sprite, lut_expand, colors, opaque, tx, ty, flipy);
 		}
-	} else {
-		for (v = 0; v < 8; v++, layerptr++) {
-			if ((y + v) < (PPU_TILES_HEIGHT * 8)) {
-				Uint8 ch1 = sprite[v ^ flipy];
-				Uint8 ch2 = sprite[(v ^ flipy) | 8];
-				u32 data32 = 0;
-				u32 mask32 = 0;
-
-				if (!flipx) {
-					for (h = 0; h < 8; h++) {
-						data32 <<= 4; mask32 <<= 4;
-
-						if ((ch1 | ch2) & 1) {
-							Uint8 ch = (ch1 & 1) | ((ch2 & 1) << 1);
-							data32 |= blending[ch][color];
-							mask32 |= 0x3;
-						}
-
-						ch1 >>= 1; ch2 >>= 1;
-					}
-				} else {
-					for (h = 0; h < 8; h++) {
-						data32 <<= 4; mask32 <<= 4;
-
-						if ((ch1 | ch2) & 128) {
-							Uint8 ch = (ch1 >> 7) | ((ch2 >> 7) << 1);
-							data32 |= blending[ch][color];
-							mask32 |= 0x3;
-						}
-
-						ch1 <<= 1; ch2 <<= 1;
-					}
-				}
-
-				u64 data = ((u64) (data32)) << shift;
-				u64 mask = ~(((u64) (mask32)) << shift);
-
-				if (xleftedge) layerptr[0] = (layerptr[0] & mask) | data;
-				if (xrightedge) layerptr[8] = (layerptr[8] & (mask >> 32)) | (data >> 32);
-			} else if (!flipy) break;
-
-			if (((y + v) & 7) == 7) layerptr += (PPU_TILES_WIDTH - 1) * 8;
+
+		if (strip) {
+			dirty_cols |= __nds_ppu_dirty_mask(tx, PPU_PIXELS_WIDTH);
+			dirty_rows |= __nds_ppu_dirty_mask(ty, PPU_PIXELS_HEIGHT);
+		} else {
+			Uint32 cols = __nds_ppu_dirty_mask(tx, PPU_PIXELS_WIDTH);
+			if (ty >= 0) tile_dirty[ty >> 3] |= cols;
+			if (ty + 7 < PPU_PIXELS_HEIGHT) tile_dirty[(ty + 7) >> 3] |= cols;
 		}
 	}
 
-	if (y >= 0) tile_dirty[y >> 3] |= dirtyflag;
-	tile_dirty[(y + 7) >> 3] |= dirtyflag;
+	while ((i = __builtin_ffs(dirty_rows)) > 0) {
+		tile_dirty[i - 1] |= dirty_cols;
+		dirty_rows ^= 1u << (i - 1);
+	}
 }
 
 /* output */
@@ -397,33 +372,51 @@ drawdebugger(NdsPpu *p, Uint8 *stack, Uint8 ptr)
 	}
 } */
 
-typedef struct {
-	Uint32 a, b, c, d, e, f, g, h;
-} TileBackup;
-
-static inline void
-copytile(TileBackup *tptr)
+// Copies a run of n back buffer tiles to the displayed layer, starting from the
+// first word that differs; ROMs which clear and redraw the same picture every
+// frame dirty tiles without changing them. Returns the number of tiles copied.
+static inline int
+copyrun(Uint32 *src, int n)
 {
-	TileBackup *tdstptr = (TileBackup*) (((u32) tptr) & 0xFFFEFFFF);
-	*tdstptr = *tptr;
+	Uint32 *dst = (Uint32*) (((uintptr_t) src) & 0xFFFEFFFF);
+	int i, words = n * 8;
+	for (i = 0; i < words && src[i] == dst[i]; i++);
+	if (i < words)
+		memcpy(dst + i, src + i, (words - i) * 4);
+	return n - (i >> 3);
 }
 
 ITCM_ARM_CODE
 void
 nds_copyppu(NdsPpu *p)
 {
-	int i, k, ofs;
-
-	for (i = 0; i < 24; i++) {
-		if (tile_dirty[i] != 0) {
-			while ((k = __builtin_ffs(tile_dirty[i])) > 0) {
-				k--;
-				ofs = (i << 8) | (k << 3);
-				copytile((TileBackup*) (p->bg + ofs));
-				copytile((TileBackup*) (p->fg + ofs));
-				tile_dirty[i] ^= (1 << k);
+	int i, k, n, ofs, copied;
+	Uint32 dirty;
+
+	for (i = 0; i < PPU_TILES_HEIGHT; i++) {
+		dirty = tile_dirty[i];
+		while (dirty != 0) {
+			if (dirty == 0xFFFFFFFF) {
+				// whole row, as after a clear
+				k = 0;
+				n = PPU_TILES_WIDTH;
+			} else {
+				// lowest run of set bits
+				k = __builtin_ctz(dirty);
+				n = __builtin_ctz(~(dirty >> k));
 			}
+			ofs = (i << 8) | (k << 3);
+			copied = copyrun(p->bg + ofs, n);
+			copied += copyrun(p->fg + ofs, n);
+#ifdef DEBUG_PROFILE
+			nds_ppu_stats.tiles_copied += copied;
+			nds_ppu_stats.tiles_skipped += n * 2 - copied;
+#endif
+			if (n == PPU_TILES_WIDTH)
+				break;
+			dirty &= ~(((1u << n) - 1) << k);
 		}
+		tile_dirty[i] = 0;
 	}
 
 	if (pal_colors_cache_changed) {
@@ -28,10 +28,21 @@ typedef struct NdsPpu {
 	Uint32 *bg, *fg;
 } NdsPpu;
 
+#ifdef DEBUG_PROFILE
+// Counts since the last reset: sprites split by the path taken through nds_ppu_sprite,
+// dirty layer tiles by whether nds_copyppu had to copy them.
+typedef struct NdsPpuStats {
+	Uint32 sprites, sprites_2bpp, sprites_flipped;
+	Uint32 sprites_aligned, sprites_clipped, sprites_hidden;
+	Uint32 tiles_copied, tiles_skipped;
+} NdsPpuStats;
+
+extern NdsPpuStats nds_ppu_stats;
+#endif
+
 int nds_initppu(NdsPpu *p);
 void nds_putcolors(NdsPpu *p, Uint8 *addr);
 void nds_ppu_pixel(NdsPpu *p, Uint32 *layer, Uint16 x, Uint16 y, Uint8 color);
 void nds_ppu_fill(NdsPpu *p, Uint32 *layer, Uint16 x1, Uint16 y1, Uint16 x2, Uint16 y2, Uint8 color);
-void nds_ppu_2bpp(NdsPpu *p, Uint32 *layer, int16_t x, int16_t y, Uint8 *sprite, Uint8 color, Uint8 flipx, Uint8 flipy);
-void nds_ppu_1bpp(NdsPpu *p, Uint32 *layer, int16_t x, int16_t y, Uint8 *sprite, Uint8 color, Uint8 flipx, Uint8 flipy);
+void nds_ppu_sprite(NdsPpu *p, Uint32 *layer, Uint16 x, Uint16 y, Uint16 dx, Uint16 dy, Uint8 *sprite, Uint16 sprite_step, Uint8 count, Uint8 color, Uint8 flipx, Uint8 flipy, Uint8 twobpp);
 void nds_copyppu(NdsPpu *p);
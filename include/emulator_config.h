@@ -2,3 +2,10 @@
 #define ENABLE_KEYBOARD
 #define ENABLE_TOUCH
 // #define USE_BOTTOM_SCREEN_DEFAULT
+// #define ENABLE_CTR_RENDER_THREAD
+// Frames in a row which may skip presenting when the screen vector overruns; 0 disables skipping.
+#define FRAMESKIP_MAX 2
+// Output sample rate used instead of SAMPLE_FREQUENCY, trading treble for mixing time.
+// #define AUDIO_LOW_POWER_RATE 16000
+// 3DS debug: also writes everything mixed to this WAV file, for listening to or diffing offline.
+// #define AUDIO_CAPTURE "sdmc:/uxn-capture.wav"
@@ -14,17 +14,47 @@ WITH REGARD TO THIS SOFTWARE.
 typedef unsigned int Uint32;
 typedef signed int Sint32;
 
-#define SAMPLE_FREQUENCY 22050
+#define SAMPLE_FREQUENCY 22050 /* unless changed with nds_apu_set_rate */
+#define NDS_LINES_PER_SECOND 15734 /* 263 scanlines at ~59.83 frames per second */
 #define POLYPHONY 4
 
 typedef struct {
 	Uint8 *addr;
 	Uint32 count, advance, period, age, a, d, s, r;
+	Uint32 step, step_rem; /* advance / period, advance % period */
+	Sint32 env, env_rem, env_step, env_step_rem, env_div; /* envelope(age) as env + env_rem / env_div */
+	Uint32 env_end; /* age at which the next segment starts */
 	Uint16 i, len;
 	Sint8 volume[2];
 	Uint8 pitch, repeat;
 } NdsApu;
 
-void nds_apu_render(NdsApu *c, Sint16 *sample_left, Sint16 *sample_right, int samples); /* ARM7 */
+#define NDS_APU_QUEUE_SIZE 32 /* power of two; a voice per instance per frame over the largest apu_delay and buffer */
+
+/* Counted by the ARM7, in scanlines of the shared line clock. */
+typedef struct {
+	Uint32 buffers, late; /* buffers mixed, and those not done before the next one was due */
+	Uint32 mix_time, mix_time_peak; /* spent mixing one buffer */
+	Uint32 latency, latency_peak; /* from the start of the frame pushing a voice to it reaching the speakers */
+	Uint32 dropped; /* voices lost to a full queue, counted by the ARM9 in nds_apu_push */
+} NdsApuStats;
+
+/* Voices started by the ARM9, in main RAM for the ARM7 to pick up. Each side
+only writes its own index: head by the ARM9, tail by the ARM7. Aligned and
+padded to whole ARM9 cache lines, so that no line the ARM9 writes back from
+its cache can overlap what the ARM7 writes here. */
+typedef struct __attribute__((aligned(32))) {
+	NdsApu voice[NDS_APU_QUEUE_SIZE];
+	Uint32 time[NDS_APU_QUEUE_SIZE]; /* line clock at the start of the frame which pushed the voice */
+	Uint8 instance[NDS_APU_QUEUE_SIZE];
+	volatile Uint32 head, tail;
+	volatile Uint32 frames; /* counted by the ARM7 at each VBlank */
+	NdsApuStats stats;
+} NdsApuQueue;
+
+int nds_apu_render(NdsApu *c, Sint32 *sample_left, Sint32 *sample_right, int samples); /* ARM7 */
 void nds_apu_start(NdsApu *c, Uint16 adsr, Uint8 pitch, Uint8 detune); /* ARM9 */
+void nds_apu_set_rate(Uint32 rate); /* ARM9 */
+Uint32 nds_apu_get_rate(void); /* ARM9 */
+int nds_apu_push(NdsApuQueue *q, int instance, NdsApu *c, Uint32 time); /* ARM9 */
 Uint8 nds_apu_get_vu(NdsApu *c); /* ARM9 */
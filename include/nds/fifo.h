@@ -15,9 +15,13 @@ WITH REGARD TO THIS SOFTWARE.
 #define UXNDS_FIFO_CHANNEL FIFO_USER_01
 #define UXNDS_FIFO_CMD_SET_RATE	0x10000000
 #define UXNDS_FIFO_CMD_SET_ADDR	0x20000000
-#define UXNDS_FIFO_CMD_APU0	0x80000000
-#define UXNDS_FIFO_CMD_APU1	0x90000000
-#define UXNDS_FIFO_CMD_APU2	0xA0000000
-#define UXNDS_FIFO_CMD_APU3	0xB0000000
+#define UXNDS_FIFO_CMD_SET_QUEUE	0x30000000
 #define UXNDS_FIFO_CMD_MASK	0xF0000000
 
+// Scanlines since the first VBlank, given the VBlanks counted so far and the
+// current line; the caller must count a VBlank that is pending but not yet
+// handled, or the clock drops by a frame between line 192 and the handler.
+static inline u32 uxnds_line_clock(u32 frames, u32 line) {
+	return frames * 263 + (line >= 192 ? line - 192 : line + 263 - 192);
+}
+
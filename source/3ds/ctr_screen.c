@@ -25,23 +25,25 @@ WITH REGARD TO THIS SOFTWARE.
 
 UxnCtrScreen uxn_ctr_screen;
 
-/* c = !ch ? (color % 5 ? color >> 2 : 0) : color % 4 + ch == 1 ? 0 : (ch - 2 + (color & 3)) % 3 + 1; */
-
-static Uint8 blending[4][16] = {
-	{0, 0, 0, 0, 1, 0, 1, 1, 2, 2, 0, 2, 3, 3, 3, 0},
-	{0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
-	{1, 2, 3, 1, 1, 2, 3, 1, 1, 2, 3, 1, 1, 2, 3, 1},
-	{2, 3, 1, 2, 2, 3, 1, 2, 2, 3, 1, 2, 2, 3, 1, 2}};
+static Uint8 blending[5][16] = {
+#include "../devices/blending.inc"
+};
 
 static inline void
 screen_change(UxnCtrScreen *scr, Layer *s, Uint16 x1, Uint16 y1, Uint16 x2, Uint16 y2)
 {
 	if(y1 > scr->height && y2 > y1) return;
+	if(x1 > scr->width && x2 > x1) return;
 	if(y1 > y2) y1 = 0;
 	if(y1 >= scr->height) s->y1 = 0;
 	else if(y1 < s->y1) s->y1 = y1;
 	if(y2 > scr->height) s->y2 = scr->height;
 	else if(y2 > s->y2) s->y2 = y2;
+	if(x1 > x2) x1 = 0;
+	if(x1 >= scr->width) s->x1 = 0;
+	else if(x1 < s->x1) s->x1 = x1;
+	if(x2 > scr->width) s->x2 = scr->width;
+	else if(x2 > s->x2) s->x2 = x2;
 }
 
 __attribute__((optimize("-O3")))
@@ -51,80 +53,149 @@ screen_fill(UxnCtrScreen *s, Uint8 *pixels, int x1, int y1, int x2, int y2, Uint
 	int y, width = s->width, height = s->height;
 	if (x2 > width) x2 = width;
 	if (y2 > height) y2 = height;
+	if (x1 >= x2 || y1 >= y2) return;
 	//iprintf("fill %d %d %d %d\n", x1, y1, x2, y2);
 	for(y = y1; y < y2; y++)
 		memset(pixels + (y * width) + x1, color, x2-x1);
 }
 
-__attribute__((optimize("-O3")))
+// Consecutive auto x+1 or auto y+1 pixel writes of the same layer and
+// color are collected here and drawn as a single fill.
+typedef struct {
+	Layer *layer;
+	Uint16 x, y, length;
+	Uint8 color, move;
+} PixelSpan;
+
+static PixelSpan pixel_span;
+
 static void
-screen_blit(UxnCtrScreen *s, Uint8 *pixels, Uint16 x1, Uint16 y1, Uint8 *ram, Uint16 addr, Uint8 color, Uint8 flipx, Uint8 flipy, Uint8 twobpp)
+screen_flush_pixels(UxnCtrScreen *p)
 {
-	int v, h, width = s->width, height = s->height, opaque = (color % 5);
-	if ((color == 1 || color == 5) && !flipy && !flipx && x1 <= width-8 && y1 <= height-8) {
-		// fast path
-		for(v = 0; v < 8; v++) {
-			Uint16 c = ram[(addr + v) & 0xffff] | (twobpp ? (ram[(addr + v + 8) & 0xffff] << 8) : 0);
-			Uint16 y = y1 + v;
-			if(opaque) {
-				for(h = 7; h >= 0; --h, c >>= 1) {
-					Uint8 ch = (c & 1) | ((c >> 7) & 2);
-					Uint16 x = x1 + h;
-					pixels[x + y * width] = ch;
-				}
-			} else {
-				for(h = 7; h >= 0; --h, c >>= 1) {
-					Uint8 ch = (c & 1) | ((c >> 7) & 2);
-					if(ch) {
-						Uint16 x = x1 + h;
-						pixels[x + y * width] = ch;
-					}
-				}
-			}
+	PixelSpan *s = &pixel_span;
+	Uint16 x2 = s->x + 1, y2 = s->y + 1;
+	if (!s->length) return;
+	if (s->move & 0x1) x2 = s->x + s->length;
+	else y2 = s->y + s->length;
+	screen_fill(p, s->layer->pixels, s->x, s->y, x2, y2, s->color);
+	s->layer->used |= 1 << s->color;
+	screen_change(p, s->layer, s->x, s->y, x2, y2);
+	s->length = 0;
+}
+
+static void
+screen_pixel(UxnCtrScreen *p, Layer *layer, Uint16 x, Uint16 y, Uint8 color, Uint8 move)
+{
+	PixelSpan *s = &pixel_span;
+	if (move != 0x1 && move != 0x2) {
+		screen_flush_pixels(p);
+		if (x < p->width && y < p->height)
+			layer->pixels[x + y * p->width] = color;
+		layer->used |= 1 << color;
+		screen_change(p, layer, x, y, x + 1, y + 1);
+		return;
+	}
+	if (x >= p->width || y >= p->height)
+		return;
+	if (s->length && s->layer == layer && s->color == color && s->move == move
+		&& x == s->x + (move == 0x1 ? s->length : 0)
+		&& y == s->y + (move == 0x2 ? s->length : 0)) {
+		s->length++;
+		return;
+	}
+	screen_flush_pixels(p);
+	s->layer = layer;
+	s->x = x;
+	s->y = y;
+	s->color = color;
+	s->move = move;
+	s->length = 1;
+}
+
+static Uint64 lut_expand_8_64_f[256] = {
+#include "../devices/lut_expand_8_64_f.inc"
+};
+
+static Uint64 lut_expand_8_64_f_flipx[256] = {
+#include "../devices/lut_expand_8_64_f_flipx.inc"
+};
+
+/* Expands one sprite row into eight pixels; *mask receives the pixels which get written. */
+static inline Uint64
+screen_sprite_row(Uint64 ch1, Uint64 ch2, Uint64 *colors, Uint64 opaque, Uint64 *mask)
+{
+	Uint64 both = ch1 & ch2, any = ch1 | ch2;
+	*mask = any | opaque;
+	return (colors[0] & ~any & opaque)
+		| (colors[1] & (ch1 ^ both))
+		| (colors[2] & (ch2 ^ both))
+		| (colors[3] & both);
+}
+
+/* Whole rows of eight pixels; the variants below pass twobpp and opaque as constants. */
+static inline __attribute__((always_inline)) void
+screen_blit_rows(Uint8 *dst, int width, Uint8 *ram, Uint16 addr, Uint64 *lut_expand, Uint64 *colors, Uint8 flipy, int twobpp, int opaque)
+{
+	int v;
+	for(v = 0; v < 8; v++, dst += width) {
+		Uint64 mask, row;
+		Uint64 ch1 = lut_expand[ram[(addr + (v ^ flipy)) & 0xffff]];
+		Uint64 ch2 = twobpp ? lut_expand[ram[(addr + (v ^ flipy) + 8) & 0xffff]] : 0;
+		Uint64 data = screen_sprite_row(ch1, ch2, colors, opaque ? ~0ULL : 0, &mask);
+		if (!opaque) {
+			memcpy(&row, dst, sizeof(row));
+			data |= row & ~mask;
 		}
-	} else {
-		if (flipx) flipx = 7;
-		if (flipy) flipy = 7;
-		if (x1 <= width-8) {
-			for(v = 0; v < 8; v++) {
-				Uint16 c = ram[(addr + v) & 0xffff] | (twobpp ? (ram[(addr + v + 8) & 0xffff] << 8) : 0);
-				Uint16 y = y1 + (v ^ flipy);
-				if (y >= height) continue;
-				if(opaque) {
-					for(h = 7; h >= 0; --h, c >>= 1) {
-						Uint8 ch = (c & 1) | ((c >> 7) & 2);
-						Uint16 x = x1 + (h ^ flipx);
-						pixels[x + y * width] = blending[ch][color];
-					}
-				} else {
-					for(h = 7; h >= 0; --h, c >>= 1) {
-						Uint8 ch = (c & 1) | ((c >> 7) & 2);
-						if(ch) {
-							Uint16 x = x1 + (h ^ flipx);
-							pixels[x + y * width] = blending[ch][color];
-						}
-					}
-				}
-			}
+		memcpy(dst, &data, sizeof(data));
+	}
+}
+
+typedef void (*ScreenBlitRows)(Uint8 *dst, int width, Uint8 *ram, Uint16 addr, Uint64 *lut_expand, Uint64 *colors, Uint8 flipy);
+
+#define SCREEN_BLIT_ROWS(name, twobpp, opaque) \
+	__attribute__((optimize("-O3"))) \
+	static void name(Uint8 *dst, int width, Uint8 *ram, Uint16 addr, Uint64 *lut_expand, Uint64 *colors, Uint8 flipy) \
+	{ screen_blit_rows(dst, width, ram, addr, lut_expand, colors, flipy, twobpp, opaque); }
+
+SCREEN_BLIT_ROWS(screen_blit_1bpp, 0, 0)
+SCREEN_BLIT_ROWS(screen_blit_1bpp_opaque, 0, 1)
+SCREEN_BLIT_ROWS(screen_blit_2bpp, 1, 0)
+SCREEN_BLIT_ROWS(screen_blit_2bpp_opaque, 1, 1)
+
+/* [twobpp][opaque] */
+static const ScreenBlitRows screen_blit_rows_table[2][2] = {
+	{ screen_blit_1bpp, screen_blit_1bpp_opaque },
+	{ screen_blit_2bpp, screen_blit_2bpp_opaque }
+};
+
+/* Draws count + 1 sprites, each one (dx, dy) away from the previous one. */
+__attribute__((optimize("-O3")))
+static void
+screen_blit(UxnCtrScreen *s, Uint8 *pixels, Uint16 x1, Uint16 y1, Uint16 dx, Uint16 dy, Uint8 *ram, Uint16 addr, Uint16 addr_incr, Uint8 count, Uint8 color, Uint8 flipx, Uint8 flipy, Uint8 twobpp)
+{
+	int i, v, h, width = s->width, height = s->height, opaque = blending[4][color];
+	Uint64 *lut_expand = flipx ? lut_expand_8_64_f : lut_expand_8_64_f_flipx;
+	Uint64 colors[4];
+	ScreenBlitRows rows = screen_blit_rows_table[twobpp ? 1 : 0][opaque ? 1 : 0];
+	for(i = 0; i < 4; i++)
+		colors[i] = blending[i][color] * 0x0101010101010101ULL;
+	if (flipx) flipx = 7;
+	if (flipy) flipy = 7;
+	for(i = 0; i <= count; i++, x1 += dx, y1 += dy, addr += addr_incr) {
+		if (x1 <= width-8 && y1 <= height-8) {
+			// fast path: whole rows of eight pixels
+			rows(pixels + x1 + y1 * width, width, ram, addr, lut_expand, colors, flipy);
 		} else {
 			for(v = 0; v < 8; v++) {
-				Uint16 c = ram[(addr + v) & 0xffff] | (twobpp ? (ram[(addr + v + 8) & 0xffff] << 8) : 0);
-				Uint16 y = y1 + (v ^ flipy);
+				Uint16 c = ram[(addr + (v ^ flipy)) & 0xffff] | (twobpp ? (ram[(addr + (v ^ flipy) + 8) & 0xffff] << 8) : 0);
+				Uint16 y = y1 + v;
 				if (y >= height) continue;
-				if(opaque) {
-					for(h = 7; h >= 0; --h, c >>= 1) {
-						Uint8 ch = (c & 1) | ((c >> 7) & 2);
+				for(h = 7; h >= 0; --h, c >>= 1) {
+					Uint8 ch = (c & 1) | ((c >> 7) & 2);
+					if(opaque || ch) {
 						Uint16 x = x1 + (h ^ flipx);
 						if (x < width) pixels[x + y * width] = blending[ch][color];
 					}
-				} else {
-					for(h = 7; h >= 0; --h, c >>= 1) {
-						Uint8 ch = (c & 1) | ((c >> 7) & 2);
-						if(ch) {
-							Uint16 x = x1 + (h ^ flipx);
-							if (x < width) pixels[x + y * width] = blending[ch][color];
-						}
-					}
 				}
 			}
 		}
@@ -135,6 +206,7 @@ void
 ctr_screen_palette(UxnCtrScreen *p, Uint8 *addr)
 {
 	int i, shift;
+	Uint8 changed = 0;
 	for(i = 0, shift = 4; i < 4; ++i, shift ^= 4) {
 		Uint8
 			r = (addr[0 + i / 2] >> shift) & 0xf,
@@ -144,20 +216,27 @@ ctr_screen_palette(UxnCtrScreen *p, Uint8 *addr)
 		color |= color << 4;
 		if (color != p->bg.palette[i]) {
 			p->bg.palette[i] = color;
-			screen_change(p, &p->bg, 0, 0, p->width, p->height);
-			if (i > 0) {
-				p->fg.palette[i] = color;
-				screen_change(p, &p->fg, 0, 0, p->width, p->height);
-			}
+			if (i > 0) p->fg.palette[i] = color;
+			changed |= 1 << i;
 		}
 	}
 	p->fg.palette[0] = 0;
+	for(i = 0; i < 16; i++) {
+		p->bg.palette2[i] = p->bg.palette[i & 3] | (Uint64) p->bg.palette[i >> 2] << 32;
+		p->fg.palette2[i] = p->fg.palette[i & 3] | (Uint64) p->fg.palette[i >> 2] << 32;
+	}
+	// only layers which hold one of the changed colors need converting again
+	if (changed & p->bg.used)
+		screen_change(p, &p->bg, 0, 0, p->width, p->height);
+	if (changed & p->fg.used & ~1)
+		screen_change(p, &p->fg, 0, 0, p->width, p->height);
 }
 
 static void
 ctr_screen_clear_layer(UxnCtrScreen *p, Layer *layer)
 {
 	memset(layer->pixels, 0, p->width * p->height);
+	layer->used = 1;
 	screen_change(p, layer, 0, 0, p->width, p->height);
 }
 
@@ -168,6 +247,11 @@ ctr_screen_free(UxnCtrScreen *p)
 	linearFree(p->fg.gpuPixels);
 	free(p->bg.pixels);
 	free(p->fg.pixels);
+	free(p->bg.snapshot);
+	free(p->fg.snapshot);
+	p->bg.snapshot = p->fg.snapshot = NULL;
+	p->bg.snap_y1 = p->bg.snap_y2 = 0;
+	p->fg.snap_y1 = p->fg.snap_y2 = 0;
 	C3D_TexDelete(&p->bg.gpuTexture);
 	C3D_TexDelete(&p->fg.gpuTexture);
 }
@@ -212,31 +296,36 @@ ctr_screen_init(UxnCtrScreen *p, int width, int height)
 	}
 }
 
+__attribute__((optimize("-O3")))
 static void
-ctr_screen_redraw_layer(UxnCtrScreen *p, Layer *layer)
+ctr_screen_convert_layer(UxnCtrScreen *p, Layer *layer, Uint8 *src, Uint64 *palette2, int x1, int y1, int x2, int y2)
 {
-	Uint32 x, y, width = p->width, height = p->height, pitch_step = p->pitch - p->width, *dest = layer->gpuPixels;
-	Uint8 *src = layer->pixels;
-
-	int y1 = layer->y1;
-	int y2 = layer->y2;
-	// done in screen_change
-	// if (y1 < 0) y1 = 0;
-	// if (y2 > height) y2 = height;
+	Uint32 x, y, width = p->width, *dest = layer->gpuPixels;
 	int yh = y2 - y1;
 
+	// pixels are converted in pairs; the width is always even
+	x1 &= ~1;
+	x2 = (x2 + 1) & ~1;
+
 	src += y1 * p->width;
 	dest += y1 * p->pitch;
 	Uint32 *destStart = dest;
 
 	GSPGPU_InvalidateDataCache(destStart, p->pitch * yh * 4);
-	for(y = y1; y < y2; y++, dest += pitch_step) {
-		for (x = 0; x < width; x++) {
-			*(dest++) = layer->palette[*(src++)];
+	for(y = y1; y < y2; y++, src += width, dest += p->pitch) {
+		for (x = x1; x < x2; x += 2) {
+			// two 2-bit indices -> one 4-bit index -> two RGBA8 pixels
+			Uint16 h;
+			memcpy(&h, src + x, sizeof(h));
+			memcpy(dest + x, &palette2[(h | (h >> 6)) & 0xf], sizeof(Uint64));
 		}
 	}
 	GSPGPU_FlushDataCache(destStart, p->pitch * yh * 4);
+}
 
+static void
+ctr_screen_transfer_layer(UxnCtrScreen *p, Layer *layer, int y1, int y2)
+{
 	int transferY = y1 & (~7);
 	int transferHeight = ((y2 + 7) & (~7)) - transferY;
 
@@ -248,18 +337,95 @@ ctr_screen_redraw_layer(UxnCtrScreen *p, Layer *layer)
 		GX_TRANSFER_IN_FORMAT(GX_TRANSFER_FMT_RGBA8) |
 		GX_TRANSFER_OUT_FORMAT(GX_TRANSFER_FMT_RGBA8))
 	);
+}
 
-	layer->y1 = height;
+static void
+ctr_screen_reset_layer(UxnCtrScreen *p, Layer *layer)
+{
+	layer->y1 = p->height;
 	layer->y2 = 0;
+	layer->x1 = p->width;
+	layer->x2 = 0;
+}
+
+static void
+ctr_screen_redraw_layer(UxnCtrScreen *p, Layer *layer)
+{
+	// done in screen_change
+	// if (y1 < 0) y1 = 0;
+	// if (y2 > height) y2 = height;
+	ctr_screen_convert_layer(p, layer, layer->pixels, layer->palette2, layer->x1, layer->y1, layer->x2, layer->y2);
+	ctr_screen_transfer_layer(p, layer, layer->y1, layer->y2);
+	ctr_screen_reset_layer(p, layer);
 }
 
 void
 ctr_screen_redraw(UxnCtrScreen *p)
 {
+	screen_flush_pixels(p);
 	if (p->bg.y2 > p->bg.y1) ctr_screen_redraw_layer(p, &p->bg);
 	if (p->fg.y2 > p->fg.y1) ctr_screen_redraw_layer(p, &p->fg);
 }
 
+/* Split redraw, for converting on another thread: ctr_screen_snapshot copies
+   the dirty part of each layer aside, ctr_screen_convert converts that copy
+   and ctr_screen_present uploads the result. Only ctr_screen_convert may run
+   concurrently with drawing. */
+
+static void
+ctr_screen_snapshot_layer(UxnCtrScreen *p, Layer *layer)
+{
+	int y, x1, x2;
+	layer->snap_y1 = layer->snap_y2 = 0;
+	if (layer->y2 <= layer->y1) return;
+	if (!layer->snapshot && !(layer->snapshot = malloc(p->width * p->height))) {
+		// out of memory; fall back to a synchronous redraw
+		ctr_screen_redraw_layer(p, layer);
+		return;
+	}
+	// copy the columns ctr_screen_convert_layer will read: it widens the span to whole pairs
+	x1 = layer->x1 & ~1;
+	x2 = (layer->x2 + 1) & ~1;
+	for (y = layer->y1; y < layer->y2; y++)
+		memcpy(layer->snapshot + y * p->width + x1, layer->pixels + y * p->width + x1, x2 - x1);
+	memcpy(layer->snap_palette2, layer->palette2, sizeof(layer->palette2));
+	layer->snap_x1 = layer->x1;
+	layer->snap_y1 = layer->y1;
+	layer->snap_x2 = layer->x2;
+	layer->snap_y2 = layer->y2;
+	ctr_screen_reset_layer(p, layer);
+}
+
+void
+ctr_screen_snapshot(UxnCtrScreen *p)
+{
+	screen_flush_pixels(p);
+	ctr_screen_snapshot_layer(p, &p->bg);
+	ctr_screen_snapshot_layer(p, &p->fg);
+}
+
+void
+ctr_screen_convert(UxnCtrScreen *p)
+{
+	Layer *layer = &p->bg;
+	for (int i = 0; i < 2; i++, layer = &p->fg) {
+		if (layer->snap_y2 > layer->snap_y1)
+			ctr_screen_convert_layer(p, layer, layer->snapshot, layer->snap_palette2,
+				layer->snap_x1, layer->snap_y1, layer->snap_x2, layer->snap_y2);
+	}
+}
+
+void
+ctr_screen_present(UxnCtrScreen *p)
+{
+	Layer *layer = &p->bg;
+	for (int i = 0; i < 2; i++, layer = &p->fg) {
+		if (layer->snap_y2 > layer->snap_y1)
+			ctr_screen_transfer_layer(p, layer, layer->snap_y1, layer->snap_y2);
+		layer->snap_y1 = layer->snap_y2 = 0;
+	}
+}
+
 Uint8
 ctr_screen_dei(Uint8 *d, Uint8 addr)
 {
@@ -277,11 +443,13 @@ ctr_screen_deo(Uint8 *d, Uint8 port)
 {
 	switch(port) {
 	case 0x3:
+		screen_flush_pixels(&uxn_ctr_screen);
 		// ctr_screen_resize(&uxn_ctr_screen, PEEK2(d + 2), uxn_ctr_screen.height);
 		ctr_screen_clear_layer(&uxn_ctr_screen, &uxn_ctr_screen.bg);
 		ctr_screen_clear_layer(&uxn_ctr_screen, &uxn_ctr_screen.fg);
 		break;
 	case 0x5:
+		screen_flush_pixels(&uxn_ctr_screen);
 		// ctr_screen_resize(&uxn_ctr_screen, uxn_ctr_screen.width, PEEK2(d + 4));
 		ctr_screen_clear_layer(&uxn_ctr_screen, &uxn_ctr_screen.bg);
 		ctr_screen_clear_layer(&uxn_ctr_screen, &uxn_ctr_screen.fg);
@@ -298,23 +466,23 @@ ctr_screen_deo(Uint8 *d, Uint8 port)
 			Uint16 y2 = uxn_ctr_screen.height;
 			if(ctrl & 0x10) x2 = x, x = 0;
 			if(ctrl & 0x20) y2 = y, y = 0;
+			screen_flush_pixels(&uxn_ctr_screen);
 			screen_fill(&uxn_ctr_screen, layer->pixels, x, y, x2, y2, color);
+			if (x == 0 && y == 0 && x2 >= uxn_ctr_screen.width && y2 >= uxn_ctr_screen.height)
+				layer->used = 1 << color;
+			else
+				layer->used |= 1 << color;
 			screen_change(&uxn_ctr_screen, layer, x, y, x2, y2);
 		}
 		/* pixel mode */
 		else {
-			Uint16 width = uxn_ctr_screen.width;
-			Uint16 height = uxn_ctr_screen.height;
-			if(x < width && y < height)
-				layer->pixels[x + y * width] = color;
-			screen_change(&uxn_ctr_screen, layer, x, y, x + 1, y + 1);
+			screen_pixel(&uxn_ctr_screen, layer, x, y, color, d[0x6] & 0x3);
 			if(d[0x6] & 0x1) POKE2(d + 0x8, x + 1); /* auto x+1 */
 			if(d[0x6] & 0x2) POKE2(d + 0xa, y + 1); /* auto y+1 */
 		}
 		break;
 	}
 	case 0xf: {
-		Uint8 i;
 		Uint8 ctrl = d[0xf];
 		Uint8 move = d[0x6];
 		Uint8 length = move >> 4;
@@ -327,11 +495,15 @@ ctr_screen_deo(Uint8 *d, Uint8 port)
 		int flipx = (ctrl & 0x10), fx = flipx ? -1 : 1;
 		int flipy = (ctrl & 0x20), fy = flipy ? -1 : 1;
 		Uint16 dyx = dy * fx, dxy = dx * fy;
-		for(i = 0; i <= length; i++) {
-			screen_blit(&uxn_ctr_screen, layer->pixels, x + dyx * i, y + dxy * i, u.ram.dat, addr, color, flipx, flipy, twobpp);
-			addr += addr_incr;
-		}
-		screen_change(&uxn_ctr_screen, layer, x, y, x + dyx * length + 8, y + dxy * length + 8);
+		// flipped strips extend left/up from the start position
+		Uint16 sx = flipx ? x + dyx * length : x;
+		Uint16 sy = flipy ? y + dxy * length : y;
+		screen_flush_pixels(&uxn_ctr_screen);
+		screen_blit(&uxn_ctr_screen, layer->pixels, x, y, dyx, dxy, u.ram.dat, addr, addr_incr, length, color, flipx, flipy, twobpp);
+		layer->used |= 1 << blending[1][color] | 1 << blending[2][color] | 1 << blending[3][color];
+		if (blending[4][color]) layer->used |= 1 << blending[0][color];
+		addr += addr_incr * (length + 1);
+		screen_change(&uxn_ctr_screen, layer, sx, sy, sx + dy * length + 8, sy + dx * length + 8);
 		if(move & 0x1) POKE2(d + 0x8, x + dx * fx); /* auto x+8 */
 		if(move & 0x2) POKE2(d + 0xa, y + dy * fy); /* auto y+8 */
 		if(move & 0x4) POKE2(d + 0xc, addr);        /* auto addr+length */
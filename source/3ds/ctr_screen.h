@@ -16,12 +16,18 @@ WITH REGARD TO THIS SOFTWARE.
 #include <tex3ds.h>
 
 typedef struct Layer {
-	int y1, y2;
+	int x1, y1, x2, y2;
 	Uint32 palette[4];
+	Uint64 palette2[16]; /* two pixels per entry, indexed by a << 2 | b */
 	Uint32 *gpuPixels;
 	C2D_Image gpuImage;
 	C3D_Tex gpuTexture;
 	Uint8 *pixels, changed;
+	Uint8 used; /* bitmask of the colors which may appear in pixels */
+	/* dirty area handed over by ctr_screen_snapshot */
+	Uint8 *snapshot;
+	int snap_x1, snap_y1, snap_x2, snap_y2;
+	Uint64 snap_palette2[16];
 } Layer;
 
 typedef struct UxnCtrScreen {
@@ -36,6 +42,9 @@ void ctr_screen_palette(UxnCtrScreen *p, Uint8 *addr);
 void ctr_screen_free(UxnCtrScreen *p);
 void ctr_screen_init(UxnCtrScreen *p, int width, int height);
 void ctr_screen_redraw(UxnCtrScreen *p);
+void ctr_screen_snapshot(UxnCtrScreen *p);
+void ctr_screen_convert(UxnCtrScreen *p);
+void ctr_screen_present(UxnCtrScreen *p);
 
 Uint8 ctr_screen_dei(Uint8 *d, Uint8 addr);
 void ctr_screen_deo(Uint8 *d, Uint8 port);
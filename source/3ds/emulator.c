@@ -30,7 +30,9 @@ WITH REGARD TO THIS SOFTWARE.
 
 #define PPU_PIXELS_WIDTH 320
 #define PPU_PIXELS_HEIGHT 240
-#define AUDIO_BUFFER_SIZE 2048
+#define AUDIO_BUFFER_SIZE 2048 // frames per buffer, at most
+#define AUDIO_BUFFER_MIN 512
+#define AUDIO_BUFFER_CLEAN 64 // buffers without an underrun before trying a smaller size
 // #define DEBUG_CONSOLE
 
 static C3D_RenderTarget *topLeft, *topRight, *bottom;
@@ -38,7 +40,17 @@ static C3D_RenderTarget *topLeft, *topRight, *bottom;
 static bool soundFillBlock;
 static ndspWaveBuf soundBuffer[2];
 static u8 *soundData;
-static LightLock soundLock;
+static int soundFrames = AUDIO_BUFFER_SIZE, soundFloor, soundClean;
+#ifdef AUDIO_CAPTURE
+#define AUDIO_CAPTURE_SIZE (AUDIO_BUFFER_SIZE * 8) // frames, power of two
+static FILE *soundCapture;
+static Uint32 soundCaptured; // frames written after the header, which quit() fills in
+// Mixed frames, queued by the callback for the main loop to write: the
+// callback runs on the sound thread, which must not wait on the SD card.
+// Each side only writes its own index.
+static Uint32 soundCaptureQueue[AUDIO_CAPTURE_SIZE];
+static Uint32 soundCaptureHead, soundCaptureTail, soundCaptureDropped;
+#endif
 
 #define PAD 0
 
@@ -47,6 +59,7 @@ static LightLock soundLock;
 
 Uint8 dispswap;
 Uint8 reqdraw = 0;
+Uint32 frames_skipped = 0;
 
 int prompt_reset(Uxn *u);
 
@@ -73,24 +86,128 @@ audio_finished_handler(int instance)
 
 }
 
+Uint32
+audio_clock(void)
+{
+	return svcGetSystemTick() * audio_get_rate() / SYSCLOCK_ARM11;
+}
+
+// Settles on the smallest buffer which does not run dry: doubling after an
+// underrun, halving after a clean stretch but never back to a size which ran dry.
+static void
+audio_adapt(bool late)
+{
+	if (late) {
+		soundFloor = soundFrames;
+		if (soundFrames < AUDIO_BUFFER_SIZE)
+			soundFrames *= 2;
+		soundClean = 0;
+	} else if (++soundClean >= AUDIO_BUFFER_CLEAN) {
+		if (soundFrames / 2 >= AUDIO_BUFFER_MIN && soundFrames / 2 > soundFloor)
+			soundFrames /= 2;
+		soundClean = 0;
+	}
+}
+
+#ifdef AUDIO_CAPTURE
+// Sound thread: queues a mixed block, or counts it as dropped if the main loop is that far behind.
+static void
+audio_capture_push(Sint16 *samples, Uint32 frames)
+{
+	Uint32 head = soundCaptureHead, tail = __atomic_load_n(&soundCaptureTail, __ATOMIC_ACQUIRE), i;
+	if (AUDIO_CAPTURE_SIZE - (head - tail) < frames) {
+		soundCaptureDropped += frames;
+		return;
+	}
+	for (i = 0; i < frames; i++, head++)
+		memcpy(&soundCaptureQueue[head % AUDIO_CAPTURE_SIZE], samples + i * 2, 4);
+	__atomic_store_n(&soundCaptureHead, head, __ATOMIC_RELEASE);
+}
+
+// Main thread: writes out what the callback queued, in at most two runs.
+static void
+audio_capture_write(void)
+{
+	Uint32 tail = soundCaptureTail, head = __atomic_load_n(&soundCaptureHead, __ATOMIC_ACQUIRE);
+	while (soundCapture && tail != head) {
+		Uint32 start = tail % AUDIO_CAPTURE_SIZE, n = head - tail;
+		if (n > AUDIO_CAPTURE_SIZE - start)
+			n = AUDIO_CAPTURE_SIZE - start;
+		if (fwrite(&soundCaptureQueue[start], 4, n, soundCapture) != n) {
+			fclose(soundCapture);
+			soundCapture = NULL;
+			break;
+		}
+		soundCaptured += n;
+		tail += n;
+	}
+	__atomic_store_n(&soundCaptureTail, head, __ATOMIC_RELEASE);
+}
+#endif
+
 static void
 audio_callback(void *u)
 {
 	if (soundBuffer[soundFillBlock].status == NDSP_WBUF_DONE) {
-		int i;
 		Sint16 *samples = (Sint16 *) soundBuffer[soundFillBlock].data_vaddr;
-		memset(samples, 0, AUDIO_BUFFER_SIZE * 4);
-		LightLock_Lock(&soundLock);
-		for(i = 0; i < POLYPHONY; ++i)
-			audio_render(i, samples, samples + (AUDIO_BUFFER_SIZE * 2));
-		LightLock_Unlock(&soundLock);
-		DSP_FlushDataCache(samples, AUDIO_BUFFER_SIZE * 4);
+		Uint32 late = audio_stats.late;
+		soundBuffer[soundFillBlock].nsamples = soundFrames;
+		audio_mix(samples, soundFrames);
+#ifdef AUDIO_CAPTURE
+		audio_capture_push(samples, soundFrames);
+#endif
+		DSP_FlushDataCache(samples, soundFrames * 4);
+		audio_adapt(audio_stats.late != late);
 		ndspChnWaveBufAdd(0, &soundBuffer[soundFillBlock]);
 		soundFillBlock = !soundFillBlock;
 	}
 }
 
 static u32 vsync_counter = 0;
+static u32 skip_run = 0;
+
+#ifdef ENABLE_CTR_RENDER_THREAD
+// Converts the previous frame's layers on the second core while the VM runs.
+static Thread renderThread;
+static LightEvent renderStart, renderDone;
+static volatile bool renderQuit;
+
+static void
+render_thread(void *arg)
+{
+	while (true) {
+		LightEvent_Wait(&renderStart);
+		if (renderQuit) break;
+		ctr_screen_convert(&uxn_ctr_screen);
+		LightEvent_Signal(&renderDone);
+	}
+}
+
+static void
+render_thread_init(void)
+{
+	s32 prio = 0x30;
+	LightEvent_Init(&renderStart, RESET_ONESHOT);
+	LightEvent_Init(&renderDone, RESET_ONESHOT);
+	LightEvent_Signal(&renderDone);
+	renderQuit = false;
+	svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+	APT_SetAppCpuTimeLimit(30);
+	renderThread = threadCreate(render_thread, NULL, 0x4000, prio - 1, 1, false);
+}
+
+static void
+render_thread_exit(void)
+{
+	if (!renderThread) return;
+	LightEvent_Wait(&renderDone);
+	renderQuit = true;
+	LightEvent_Signal(&renderStart);
+	threadJoin(renderThread, U64_MAX);
+	threadFree(renderThread);
+	renderThread = NULL;
+}
+#endif
 
 void
 redraw(Uxn *u)
@@ -105,9 +222,28 @@ redraw(Uxn *u)
 	int x_offset_fg = 0;
 #endif
 
+	u32 curr_frame = C3D_FrameCounter(0);
+	if (curr_frame > vsync_counter && skip_run < FRAMESKIP_MAX) {
+		// the vector overran the frame: leave converting and presenting to a later frame
+		skip_run++;
+		frames_skipped++;
+		vsync_counter = curr_frame;
+		return;
+	}
+	skip_run = 0;
+
+#ifdef ENABLE_CTR_RENDER_THREAD
+	if (renderThread) {
+		// upload what was converted during the last frame, hand over this one
+		LightEvent_Wait(&renderDone);
+		ctr_screen_present(&uxn_ctr_screen);
+		ctr_screen_snapshot(&uxn_ctr_screen);
+		LightEvent_Signal(&renderStart);
+	} else
+#endif
 	ctr_screen_redraw(&uxn_ctr_screen);
 
-	u32 curr_frame = C3D_FrameCounter(0);
+	curr_frame = C3D_FrameCounter(0);
 	if (curr_frame > vsync_counter) {
 		// ticking took >1 frame's worth
 		C3D_FrameBegin(0);
@@ -185,11 +321,20 @@ quit(void)
 
 	// APU
 	ndspExit();
-	LightLock_Lock(&soundLock);
 	linearFree(soundData);
-	LightLock_Unlock(&soundLock);
+#ifdef AUDIO_CAPTURE
+	audio_capture_write();
+	if (soundCapture) {
+		rewind(soundCapture);
+		audio_write_wav_header(soundCapture, soundCaptured);
+		fclose(soundCapture);
+	}
+#endif
 
 	// PPU
+#ifdef ENABLE_CTR_RENDER_THREAD
+	render_thread_exit();
+#endif
 	ctr_screen_free(&uxn_ctr_screen);
 	C2D_Fini();
 	C3D_Fini();
@@ -216,6 +361,9 @@ init(void)
 	topLeft = C2D_CreateScreenTarget(GFX_TOP, GFX_LEFT);
 	topRight = C2D_CreateScreenTarget(GFX_TOP, GFX_RIGHT);
 	bottom = C2D_CreateScreenTarget(GFX_BOTTOM, GFX_LEFT);
+#ifdef ENABLE_CTR_RENDER_THREAD
+	render_thread_init();
+#endif
 
 	// APU
 	float soundMix[12];
@@ -223,12 +371,21 @@ init(void)
 	soundMix[0] = soundMix[1] = 1.0f;
 	soundData = (u8*) linearAlloc(AUDIO_BUFFER_SIZE * 8);
 	memset(soundData, 0, AUDIO_BUFFER_SIZE * 8);
-	LightLock_Init(&soundLock);
 	ndspInit();
 	ndspSetOutputMode(NDSP_OUTPUT_STEREO);
 	ndspChnReset(0);
 	ndspChnSetInterp(0, NDSP_INTERP_LINEAR);
-	ndspChnSetRate(0, SAMPLE_FREQUENCY);
+#ifdef AUDIO_LOW_POWER_RATE
+	audio_set_rate(AUDIO_LOW_POWER_RATE);
+#endif
+	ndspChnSetRate(0, audio_get_rate());
+#ifdef AUDIO_CAPTURE
+	soundCapture = fopen(AUDIO_CAPTURE, "wb");
+	if (soundCapture && !audio_write_wav_header(soundCapture, 0)) {
+		fclose(soundCapture);
+		soundCapture = NULL;
+	}
+#endif
 	ndspChnSetFormat(0, NDSP_CHANNELS(2) | NDSP_ENCODING(NDSP_ENCODING_PCM16));
 	ndspChnSetMix(0, soundMix);
 	ndspSetOutputCount(1);
@@ -449,8 +606,14 @@ prompt_reset(Uxn *u)
 		return error("Resetting", "Failed");
 	if(!uxn_load_boot(u))
 		return error("Load", "Failed");
+#ifdef ENABLE_CTR_RENDER_THREAD
+	if (renderThread) LightEvent_Wait(&renderDone);
+#endif
 	ctr_screen_free(&uxn_ctr_screen);
 	ctr_screen_init(&uxn_ctr_screen, PPU_PIXELS_WIDTH, PPU_PIXELS_HEIGHT);
+#ifdef ENABLE_CTR_RENDER_THREAD
+	if (renderThread) LightEvent_Signal(&renderDone);
+#endif
 #ifdef ENABLE_KEYBOARD
 	keyboard_clear();
 #endif
@@ -472,6 +635,26 @@ restoreGfx:
 	return 0;
 }
 
+#if defined(DEBUG_CONSOLE) && defined(DEBUG_PROFILE)
+static void
+profiler_audio(void)
+{
+	iprintf("\x1b[29;0H\x1b[0Kapu %d late %u mix %u/%u lat %u/%u", soundFrames, audio_stats.late,
+		audio_stats.mix_time, audio_stats.mix_time_peak, audio_stats.latency, audio_stats.latency_peak);
+	iprintf("\x1b[28;0H\x1b[0Kwaves: cached %u, resampled %u", audio_stats.wave_hits, audio_stats.wave_misses);
+	iprintf("\x1b[27;0H\x1b[0Knotes: dropped %u", audio_stats.dropped);
+#ifdef AUDIO_CAPTURE
+	iprintf(" capture: dropped %u", soundCaptureDropped);
+#endif
+}
+
+static void
+profiler_skipped(void)
+{
+	iprintf("\x1b[26;0H\x1b[0Kskipped: %u, total %u", skip_run, frames_skipped);
+}
+#endif
+
 int
 start(Uxn *u)
 {
@@ -484,10 +667,22 @@ start(Uxn *u)
 			== (KEY_L | KEY_R | KEY_START | KEY_SELECT)) {
 			break;
 		}
+		// notes from this frame play a buffer and a frame from now, the largest buffer
+		// whatever size audio_adapt has settled on, so that resizing never moves them
+		audio_frame(AUDIO_BUFFER_SIZE + audio_get_rate() / 60);
 		doctrl(u);
 		domouse(u);
 		uxn_eval(u, GETVEC(u->dev + 0x20));
+		console_flush();
+		audio_flush();
+#ifdef AUDIO_CAPTURE
+		audio_capture_write();
+#endif
 		redraw(u);
+#if defined(DEBUG_CONSOLE) && defined(DEBUG_PROFILE)
+		profiler_audio();
+		profiler_skipped();
+#endif
 	}
 	return 1;
 }
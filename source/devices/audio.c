@@ -1,3 +1,9 @@
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "../uxn.h"
 #include "audio.h"
 
@@ -12,17 +18,42 @@ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
 WITH REGARD TO THIS SOFTWARE.
 */
 
-#define NOTE_PERIOD (SAMPLE_FREQUENCY * 0x4000 / 11025)
-#define ADSR_STEP (SAMPLE_FREQUENCY / 0xf)
+#define NOTE_PERIOD(rate) ((rate) * 0x4000 / 11025)
+#define ADSR_STEP(rate) ((rate) / 0xf)
+#define MIX_FRAMES 256
+#define AUDIO_QUEUE_SIZE 64 /* power of two; a note per voice per frame over the largest delay and block */
+#define WAVE_CACHE 8
+#define WAVE_SIZE 0x100 /* entries per resampled cycle, walked by the top 8 bits of phase */
 
 typedef struct {
 	Uint8 *addr;
 	Uint32 count, advance, period, age, a, d, s, r;
+	Uint32 step, step_rem; /* advance / period, advance % period */
+	Sint32 env, env_rem, env_step, env_step_rem, env_div; /* envelope(age) as env + env_rem / env_div */
+	Uint32 env_end; /* age at which the next segment starts */
+	Sint8 *wave; /* repeating single cycle voices: their cycle from audio_waves */
+	Uint32 phase, phase_step; /* position in the cycle, as a fraction of 2^32 */
 	Uint16 i, len;
 	Sint8 volume[2];
 	Uint8 pitch, repeat;
 } UxnAudio;
 
+/* A single cycle waveform resampled to WAVE_SIZE signed samples. */
+typedef struct {
+	Uint8 src[0x100];
+	Sint8 wave[WAVE_SIZE];
+	Uint16 len;
+	Uint32 used;
+} AudioWave;
+
+/* A note as written to the device ports, queued from the VM to the mixer. */
+typedef struct {
+	Uint8 *addr;
+	Uint32 time, at; /* audio_clock() at the start of the frame queuing it, and when it should play */
+	Uint16 len, adsr;
+	Uint8 instance, pitch, detune, volume, repeat;
+} AudioCommand;
+
 /* clang-format off */
 
 static Uint32 advances[12] = {
@@ -120,6 +151,26 @@ static double detunes[256] = {
 };
 
 static UxnAudio uxn_audio[POLYPHONY];
+static Uint8 audio_active; /* one bit per voice which may still be playing */
+static Sint32 audio_acc[MIX_FRAMES * 2];
+static AudioWave audio_waves[WAVE_CACHE];
+static Uint32 audio_waves_used;
+
+/* Single producer (audio_start), single consumer (audio_mix): each side only
+writes its own index, so neither needs a lock. */
+static AudioCommand audio_queue[AUDIO_QUEUE_SIZE];
+static Uint32 audio_queue_head, audio_queue_tail;
+static AudioCommand audio_pending[POLYPHONY]; /* the last note started on each voice this frame */
+static Uint8 audio_pending_mask;
+
+/* Written by the mixer after each run, for the device ports to read without
+touching a voice: the VU of each voice in the low byte, its position above. */
+static Uint32 audio_meters[POLYPHONY];
+
+AudioStats audio_stats;
+static Uint32 audio_due; /* audio_clock() at which the next mixed block starts playing */
+static Uint32 audio_frame_time, audio_delay;
+static Uint32 audio_rate = SAMPLE_FREQUENCY, note_period = NOTE_PERIOD(SAMPLE_FREQUENCY), adsr_step = ADSR_STEP(SAMPLE_FREQUENCY);
 
 /* clang-format on */
 
@@ -131,20 +182,87 @@ envelope(UxnAudio *c, Uint32 age)
 	if(age < c->d) return 0x0444 * (2 * c->d - c->a - age) / (c->d - c->a);
 	if(age < c->s) return 0x0444;
 	if(age < c->r) return 0x0444 * (c->r - age) / (c->r - c->s);
-	c->advance = 0;
 	return 0x0000;
 }
 
-int
-audio_render(int instance, Sint16 *sample, Sint16 *end)
+/* Starts the envelope segment containing c->age; the per-sample stepping below
+matches envelope() exactly while dividing only once per segment. */
+static void
+envelope_segment(UxnAudio *c)
+{
+	Uint32 age = c->age, n, div;
+	Sint32 step;
+	if(!c->r) {
+		n = 0x0888, div = 1, step = 0;
+		c->env_end = 0;
+	} else if(age < c->a) {
+		n = 0x0888 * age, div = c->a, step = 0x0888;
+		c->env_end = c->a;
+	} else if(age < c->d) {
+		n = 0x0444 * (2 * c->d - c->a - age), div = c->d - c->a, step = -0x0444;
+		c->env_end = c->d;
+	} else if(age < c->s) {
+		n = 0x0444, div = 1, step = 0;
+		c->env_end = c->s;
+	} else if(age < c->r) {
+		n = 0x0444 * (c->r - age), div = c->r - c->s, step = -0x0444;
+		c->env_end = c->r;
+	} else {
+		/* the note is over, the phase stops moving with it */
+		c->advance = c->step = c->step_rem = 0;
+		n = 0, div = 1, step = 0;
+		c->env_end = age + 1;
+	}
+	c->env = n / div;
+	c->env_rem = n % div;
+	c->env_div = div;
+	c->env_step = step / (Sint32)div;
+	c->env_step_rem = step % (Sint32)div;
+}
+
+static inline Sint32
+envelope_next(UxnAudio *c)
+{
+	Sint32 e;
+	if(c->age == c->env_end)
+		envelope_segment(c);
+	e = c->env;
+	c->env += c->env_step;
+	c->env_rem += c->env_step_rem;
+	if(c->env_rem >= c->env_div)
+		c->env++, c->env_rem -= c->env_div;
+	else if(c->env_rem < 0)
+		c->env--, c->env_rem += c->env_div;
+	c->age++;
+	return e;
+}
+
+/* Adds one voice to the 32-bit accumulator; returns 0 once it is silent. */
+static int
+audio_render(int instance, Sint32 *sample, Sint32 *end)
 {
 	UxnAudio *c = &uxn_audio[instance];
 	Sint32 s;
 	if(!c->advance || !c->period) return 0;
-	while(sample < end) {
-		c->count += c->advance;
-		c->i += c->count / c->period;
-		c->count %= c->period;
+	if(c->wave)
+		for(; sample < end; sample += 2) {
+			c->phase += c->phase_step;
+			s = c->wave[c->phase >> 24] * envelope_next(c);
+			sample[0] += s * c->volume[0] / 0x180;
+			sample[1] += s * c->volume[1] / 0x180;
+		}
+	else while(sample < end) {
+		c->i += c->step;
+		c->count += c->step_rem;
+		if(c->count >= c->period) {
+			c->count -= c->period;
+			c->i++;
+			if(c->count >= c->period) {
+				/* phase left over from a note with a longer period */
+				c->i += c->count / c->period;
+				c->count %= c->period;
+			}
+		}
 		if(c->i >= c->len) {
 			if(!c->repeat) {
 				c->advance = 0;
@@ -152,64 +270,263 @@ audio_render(int instance, Sint16 *sample, Sint16 *end)
 			}
 			c->i %= c->len;
 		}
-		s = (Sint8)(c->addr[c->i] + 0x80) * envelope(c, c->age++);
+		s = (Sint8)(c->addr[c->i] + 0x80) * envelope_next(c);
 		*sample++ += s * c->volume[0] / 0x180;
 		*sample++ += s * c->volume[1] / 0x180;
 	}
-	if(!c->advance) audio_finished_handler(instance);
+	if(!c->advance) {
+		audio_finished_handler(instance);
+		return 0;
+	}
 	return 1;
 }
 
-void
-audio_start(int instance, Uint8 *d, Uxn *u)
+/* Clamps n accumulated samples to 16 bits. */
+static void
+audio_saturate(Sint16 *dst, Sint32 *src, int n)
 {
-	UxnAudio *c = &uxn_audio[instance];
-	Uint8 pitch = d[0xf] & 0x7f;
-	Uint8 detune = d[0x5];
-	Uint16 addr = PEEK2(d + 0xc), adsr = PEEK2(d + 0x8);
-	c->len = PEEK2(d + 0xa);
-	if(c->len > 0x10000 - addr)
-		c->len = 0x10000 - addr;
-	c->addr = &u->ram.dat[addr];
-	c->volume[0] = d[0xe] >> 4;
-	c->volume[1] = d[0xe] & 0xf;
-	c->repeat = !(d[0xf] & 0x80);
+	int i = 0;
+#if defined(__SSE2__)
+	for(; i + 8 <= n; i += 8) {
+		__m128i lo = _mm_loadu_si128((__m128i *)(src + i)), hi = _mm_loadu_si128((__m128i *)(src + i + 4));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+	}
+#elif defined(__ARM_NEON)
+	for(; i + 8 <= n; i += 8)
+		vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(vld1q_s32(src + i)), vqmovn_s32(vld1q_s32(src + i + 4))));
+#endif
+	for(; i < n; i++)
+		dst[i] = src[i] > 0x7fff ? 0x7fff : src[i] < -0x8000 ? -0x8000 : src[i];
+}
+
+/* Finds the resampled cycle of the len bytes at addr, building it in the least
+recently used entry which no voice is playing on a miss. */
+static Sint8 *
+audio_wave(Uint8 *addr, Uint16 len)
+{
+	AudioWave *w, *lru = NULL;
+	int i, k;
+	for(i = 0; i < WAVE_CACHE; i++) {
+		w = &audio_waves[i];
+		if(w->len == len && !memcmp(w->src, addr, len)) {
+			w->used = ++audio_waves_used;
+			audio_stats.wave_hits++;
+			return w->wave;
+		}
+		for(k = 0; k < POLYPHONY; k++)
+			if((audio_active & (1 << k)) && uxn_audio[k].wave == w->wave) break;
+		if(k == POLYPHONY && (!lru || w->used < lru->used))
+			lru = w;
+	}
+	memcpy(lru->src, addr, len);
+	lru->len = len;
+	for(i = 0; i < WAVE_SIZE; i++)
+		lru->wave[i] = addr[(i * len + len / 2) / WAVE_SIZE] + 0x80;
+	lru->used = ++audio_waves_used;
+	audio_stats.wave_misses++;
+	return lru->wave;
+}
+
+static void
+audio_apply(AudioCommand *cmd)
+{
+	UxnAudio *c = &uxn_audio[cmd->instance];
+	Uint8 pitch = cmd->pitch;
+	Uint16 adsr = cmd->adsr;
+	c->len = cmd->len;
+	c->addr = cmd->addr;
+	c->volume[0] = cmd->volume >> 4;
+	c->volume[1] = cmd->volume & 0xf;
+	c->repeat = cmd->repeat;
 	if(pitch < 108 && c->len)
-		c->advance = (Uint32)((double)(advances[pitch % 12]) * detunes[detune]) >> (8 - pitch / 12);
+		c->advance = (Uint32)((double)(advances[pitch % 12]) * detunes[cmd->detune]) >> (8 - pitch / 12);
 	else {
 		c->advance = 0;
 		return;
 	}
-	c->a = ADSR_STEP * (adsr >> 12);
-	c->d = ADSR_STEP * (adsr >> 8 & 0xf) + c->a;
-	c->s = ADSR_STEP * (adsr >> 4 & 0xf) + c->d;
-	c->r = ADSR_STEP * (adsr >> 0 & 0xf) + c->s;
+	c->a = adsr_step * (adsr >> 12);
+	c->d = adsr_step * (adsr >> 8 & 0xf) + c->a;
+	c->s = adsr_step * (adsr >> 4 & 0xf) + c->d;
+	c->r = adsr_step * (adsr >> 0 & 0xf) + c->s;
 	c->age = 0;
-	c->i = 0;
+	c->env_end = 0;
 	if(c->len <= 0x100) /* single cycle mode */
-		c->period = NOTE_PERIOD * 337 / 2 / c->len;
+		c->period = note_period * 337 / 2 / c->len;
 	else /* sample repeat mode */
-		c->period = NOTE_PERIOD;
+		c->period = note_period;
+	c->i = 0;
+	c->count = 0;
+	c->step = c->advance / c->period;
+	c->step_rem = c->advance % c->period;
+	c->wave = NULL;
+	if(c->len <= 0x100 && c->repeat) {
+		c->wave = audio_wave(c->addr, c->len);
+		c->phase = 0;
+		c->phase_step = ((Uint64)c->advance << 32) / ((Uint64)c->len * c->period);
+	}
+	audio_active |= 1 << cmd->instance;
 }
 
-Uint8
-audio_get_vu(int instance)
+static Uint32
+audio_meter(int instance)
 {
 	UxnAudio *c = &uxn_audio[instance];
+	Uint32 i, vu = 0, position = c->wave ? (Uint64)c->phase * c->len >> 32 : c->i;
+	Sint32 sum;
+	if((audio_active & (1 << instance)) && c->advance && c->period)
+		for(i = 0; i < 2; i++) {
+			if(!c->volume[i]) continue;
+			sum = 1 + envelope(c, c->age) * c->volume[i] / 0x800;
+			vu |= (sum > 0xf ? 0xf : sum) << (4 - i * 4);
+		}
+	return vu | position << 8;
+}
+
+static void
+audio_peak(Uint32 *value, Uint32 *peak, Uint32 v)
+{
+	*value = v;
+	if(*peak < v) *peak = v;
+}
+
+/* Mixes all voices into frames of interleaved stereo samples, saturating once per sample;
+queued notes start on the output frame they were scheduled for, or the first one if they are late. */
+void
+audio_mix(Sint16 *sample, int frames)
+{
+	int i, n, pos;
+	Sint32 offset;
+	Uint32 now = audio_clock(), tail = audio_queue_tail, head = __atomic_load_n(&audio_queue_head, __ATOMIC_ACQUIRE);
+	/* the block plays once the one mixed before it has; the first one is
+	assumed to queue behind a block of silence, and one mixed after the
+	output ran dry plays straight away */
+	if(!audio_stats.mixes)
+		audio_due = now + frames;
+	else if((Sint32)(now - audio_due) > 0)
+		audio_due = now, audio_stats.late++;
+	audio_stats.mixes++;
+	for(pos = 0; pos < frames; pos += n, sample += n * 2) {
+		n = frames - pos < MIX_FRAMES ? frames - pos : MIX_FRAMES;
+		/* start the notes due by pos, and end this run where the next one is */
+		for(; tail != head; tail++) {
+			AudioCommand *cmd = &audio_queue[tail % AUDIO_QUEUE_SIZE];
+			offset = cmd->at - (audio_due + pos);
+			if(offset > 0) {
+				if(offset < n) n = offset;
+				break;
+			}
+			audio_peak(&audio_stats.latency, &audio_stats.latency_peak, audio_due + pos - cmd->time);
+			audio_apply(cmd);
+		}
+		memset(audio_acc, 0, n * 2 * sizeof(Sint32));
+		for(i = 0; i < POLYPHONY; i++)
+			if((audio_active & (1 << i)) && !audio_render(i, audio_acc, audio_acc + n * 2))
+				audio_active &= ~(1 << i);
+		audio_saturate(sample, audio_acc, n * 2);
+		for(i = 0; i < POLYPHONY; i++)
+			__atomic_store_n(&audio_meters[i], audio_meter(i), __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&audio_queue_tail, tail, __ATOMIC_RELEASE);
+	audio_due += frames;
+	audio_peak(&audio_stats.mix_time, &audio_stats.mix_time_peak, audio_clock() - now);
+}
+
+/* Starts a note at the end of the frame, see audio_flush. */
+void
+audio_start(int instance, Uint8 *d, Uxn *u)
+{
+	AudioCommand *cmd = &audio_pending[instance];
+	Uint16 addr = PEEK2(d + 0xc);
+	audio_pending_mask |= 1 << instance;
+	cmd->instance = instance;
+	cmd->pitch = d[0xf] & 0x7f;
+	cmd->detune = d[0x5];
+	cmd->adsr = PEEK2(d + 0x8);
+	cmd->len = PEEK2(d + 0xa);
+	if(cmd->len > 0x10000 - addr)
+		cmd->len = 0x10000 - addr;
+	cmd->addr = &u->ram.dat[addr];
+	cmd->volume = d[0xe];
+	cmd->repeat = !(d[0xf] & 0x80);
+	cmd->time = audio_frame_time;
+	cmd->at = audio_frame_time + audio_delay;
+}
+
+/* Called by the frontend as each frame ends: queues the notes started during
+it for the mixer. Only the last one on each voice is kept, as a note started
+again in the same frame would be cut on the very sample it starts; notes are
+counted as dropped if the mixer has fallen a whole queue behind. */
+void
+audio_flush(void)
+{
 	int i;
-	Sint32 sum[2] = {0, 0};
-	if(!c->advance || !c->period) return 0;
-	for(i = 0; i < 2; i++) {
-		if(!c->volume[i]) continue;
-		sum[i] = 1 + envelope(c, c->age) * c->volume[i] / 0x800;
-		if(sum[i] > 0xf) sum[i] = 0xf;
+	Uint32 head = audio_queue_head, tail = __atomic_load_n(&audio_queue_tail, __ATOMIC_ACQUIRE);
+	for(i = 0; i < POLYPHONY; i++) {
+		if(!(audio_pending_mask & (1 << i)))
+			continue;
+		if(head - tail >= AUDIO_QUEUE_SIZE)
+			audio_stats.dropped++;
+		else
+			audio_queue[head++ % AUDIO_QUEUE_SIZE] = audio_pending[i];
 	}
-	return (sum[0] << 4) | sum[1];
+	audio_pending_mask = 0;
+	__atomic_store_n(&audio_queue_head, head, __ATOMIC_RELEASE);
+}
+
+/* Sets the output rate every note and envelope is timed in; call before mixing
+anything, audio_clock() and the frontend's output must then run at it too. */
+void
+audio_set_rate(Uint32 rate)
+{
+	audio_rate = rate;
+	note_period = NOTE_PERIOD(rate);
+	adsr_step = ADSR_STEP(rate);
+}
+
+Uint32
+audio_get_rate(void)
+{
+	return audio_rate;
+}
+
+/* Called by the frontend as each frame starts: notes queued during it play
+delay frames of audio_clock() after now, which keeps them as evenly spaced as
+the frames were whatever the mixer's block size. */
+void
+audio_frame(Uint32 delay)
+{
+	audio_frame_time = audio_clock();
+	audio_delay = delay;
+}
+
+static void
+audio_put32(Uint8 *b, Uint32 v)
+{
+	b[0] = v, b[1] = v >> 8, b[2] = v >> 16, b[3] = v >> 24;
+}
+
+/* Writes the header of a WAV file holding frames of audio_mix output at the current rate, see AUDIO_CAPTURE; returns 0 on a short write. */
+int
+audio_write_wav_header(FILE *f, Uint32 frames)
+{
+	Uint8 h[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ',
+		16, 0, 0, 0, 1, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 16, 0, 'd', 'a', 't', 'a'};
+	audio_put32(h + 4, 36 + frames * 4);
+	audio_put32(h + 24, audio_rate);
+	audio_put32(h + 28, audio_rate * 4);
+	audio_put32(h + 40, frames * 4);
+	return fwrite(h, 1, sizeof(h), f) == sizeof(h);
+}
+
+/* As of the last run mixed; these only read what the mixer published, so the VM may call them while it mixes. */
+Uint8
+audio_get_vu(int instance)
+{
+	return __atomic_load_n(&audio_meters[instance], __ATOMIC_RELAXED);
 }
 
 Uint16
 audio_get_position(int instance)
 {
-	UxnAudio *c = &uxn_audio[instance];
-	return c->i;
+	return __atomic_load_n(&audio_meters[instance], __ATOMIC_RELAXED) >> 8;
 }
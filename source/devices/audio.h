@@ -15,11 +15,28 @@ typedef signed int Sint32;
 #define AUDIO_DEIMASK 0x0014
 #define AUDIO_DEOMASK 0x8000
 
-#define SAMPLE_FREQUENCY 44100
+#define SAMPLE_FREQUENCY 44100 /* unless changed with audio_set_rate */
 #define POLYPHONY 4
 
+/* Counted by audio_mix, in frames of audio_clock(). */
+typedef struct {
+	Uint32 mixes, late; /* audio_mix calls, and those made after the output ran dry */
+	Uint32 mix_time, mix_time_peak; /* spent mixing one block */
+	Uint32 latency, latency_peak; /* from the start of the frame queuing a note to it reaching the output */
+	Uint32 wave_hits, wave_misses; /* single cycle notes whose resampled cycle was cached, or not */
+	Uint32 dropped; /* notes lost to a full queue, counted by audio_flush */
+} AudioStats;
+
+extern AudioStats audio_stats;
+
 Uint8 audio_get_vu(int instance);
 Uint16 audio_get_position(int instance);
-int audio_render(int instance, Sint16 *sample, Sint16 *end);
+void audio_mix(Sint16 *sample, int frames);
+int audio_write_wav_header(FILE *f, Uint32 frames);
 void audio_start(int instance, Uint8 *d, Uxn *u);
+void audio_frame(Uint32 delay);
+void audio_flush(void);
+void audio_set_rate(Uint32 rate);
+Uint32 audio_get_rate(void);
 void audio_finished_handler(int instance);
+Uint32 audio_clock(void); /* provided by the frontend: its output clock, in frames */
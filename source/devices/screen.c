@@ -1,4 +1,11 @@
 #include <stdlib.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "../uxn.h"
 #include "screen.h"
@@ -16,45 +23,242 @@ WITH REGARD TO THIS SOFTWARE.
 
 UxnScreen uxn_screen;
 
-/* c = !ch ? (color % 5 ? color >> 2 : 0) : color % 4 + ch == 1 ? 0 : (ch - 2 + (color & 3)) % 3 + 1; */
-
-static Uint8 blending[4][16] = {
-	{0, 0, 0, 0, 1, 0, 1, 1, 2, 2, 0, 2, 3, 3, 3, 0},
-	{0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
-	{1, 2, 3, 1, 1, 2, 3, 1, 1, 2, 3, 1, 1, 2, 3, 1},
-	{2, 3, 1, 2, 2, 3, 1, 2, 2, 3, 1, 2, 2, 3, 1, 2}};
+static Uint8 blending[5][16] = {
+#include "blending.inc"
+};
 
 static void
 screen_change(int x1, int y1, int x2, int y2)
 {
+	if(x1 < 0) x1 = 0;
+	if(y1 < 0) y1 = 0;
 	if(x1 < uxn_screen.x1) uxn_screen.x1 = x1;
 	if(y1 < uxn_screen.y1) uxn_screen.y1 = y1;
 	if(x2 > uxn_screen.x2) uxn_screen.x2 = x2;
 	if(y2 > uxn_screen.y2) uxn_screen.y2 = y2;
 }
 
+/*
+Layers are kept composed as fg << 2 | bg, packed two pixels per byte with
+the even pixel in the low nibble; shift selects the layer being drawn.
+They live in 64x64 tiles which are only allocated once something other
+than color 0 is drawn into them, a missing tile reads as all zeroes.
+*/
+
+#define TILE_SIZE 64
+#define TILE_STRIDE (TILE_SIZE / 2)
+/* sprite rows are written eight bytes at a time, keep the last one in bounds */
+#define TILE_BYTES (TILE_STRIDE * TILE_SIZE + 8)
+
+/* released tiles, chained through their first bytes */
+static Uint8 *tile_pool;
+
+static Uint8 *
+screen_tile(int x, int y)
+{
+	Uint8 **tile = &uxn_screen.tiles[y / TILE_SIZE][x / TILE_SIZE];
+	if(!*tile) {
+		if(tile_pool) {
+			*tile = tile_pool;
+			memcpy(&tile_pool, tile_pool, sizeof(tile_pool));
+		} else if(!(*tile = malloc(TILE_BYTES)))
+			return NULL;
+		memset(*tile, 0, TILE_BYTES);
+	}
+	return *tile;
+}
+
 static void
-screen_fill(Uint8 *layer, int x1, int y1, int x2, int y2, int color)
+screen_tile_release(Uint8 **tile)
 {
-	int x, y, width = uxn_screen.width, height = uxn_screen.height;
-	for(y = y1; y < y2 && y < height; y++)
-		for(x = x1; x < x2 && x < width; x++)
-			layer[x + y * width] = color;
+	memcpy(*tile, &tile_pool, sizeof(tile_pool));
+	tile_pool = *tile;
+	*tile = NULL;
+}
+
+static inline void
+screen_nibble(Uint8 *row, int shift, int x, int color)
+{
+	Uint8 *b = row + (x >> 1);
+	shift += (x & 1) << 2;
+	*b = (*b & ~(0x3 << shift)) | color << shift;
+}
+
+static void
+screen_put(int shift, int x, int y, int color)
+{
+	Uint8 *tile = uxn_screen.tiles[y / TILE_SIZE][x / TILE_SIZE];
+	if(!tile && (!color || !(tile = screen_tile(x, y))))
+		return;
+	screen_nibble(tile + (y % TILE_SIZE) * TILE_STRIDE, shift, x % TILE_SIZE, color);
 }
 
 static void
-screen_blit(Uint8 *layer, Uint8 *ram, Uint16 addr, int x1, int y1, int color, int flipx, int flipy, int twobpp)
-{
-	int v, h, width = uxn_screen.width, height = uxn_screen.height, opaque = (color % 5) || !color;
-	for(v = 0; v < 8; v++) {
-		Uint16 c = ram[(addr + v) & 0xffff] | (twobpp ? (ram[(addr + v + 8) & 0xffff] << 8) : 0);
-		Uint16 y = y1 + (flipy ? 7 - v : v);
-		for(h = 7; h >= 0; --h, c >>= 1) {
-			Uint8 ch = (c & 1) | ((c >> 7) & 2);
-			if(opaque || ch) {
-				Uint16 x = x1 + (flipx ? 7 - h : h);
-				if(x < width && y < height)
-					layer[x + y * width] = blending[ch][color];
+screen_fill(int shift, int x1, int y1, int x2, int y2, int color)
+{
+	int x, y, tx, ty, width = uxn_screen.width, height = uxn_screen.height;
+	Uint8 keep = ~(0x33 << shift), value = (color * 0x11) << shift;
+	if(x2 > width) x2 = width;
+	if(y2 > height) y2 = height;
+	if(x1 >= x2 || y1 >= y2)
+		return;
+	for(ty = y1 / TILE_SIZE; ty <= (y2 - 1) / TILE_SIZE; ty++)
+		for(tx = x1 / TILE_SIZE; tx <= (x2 - 1) / TILE_SIZE; tx++) {
+			int ox = tx * TILE_SIZE, oy = ty * TILE_SIZE;
+			int lx1 = x1 > ox ? x1 - ox : 0, lx2 = x2 < ox + TILE_SIZE ? x2 - ox : TILE_SIZE;
+			int ly1 = y1 > oy ? y1 - oy : 0, ly2 = y2 < oy + TILE_SIZE ? y2 - oy : TILE_SIZE;
+			/* clearing a tile that was never drawn to changes nothing */
+			Uint8 *tile = color ? screen_tile(ox, oy) : uxn_screen.tiles[ty][tx];
+			if(!tile)
+				continue;
+			for(y = ly1; y < ly2; y++) {
+				Uint8 *row = tile + y * TILE_STRIDE;
+				x = lx1;
+				if(x & 1)
+					screen_nibble(row, shift, x++, color);
+				for(; x + 1 < lx2; x += 2)
+					row[x >> 1] = (row[x >> 1] & keep) | value;
+				if(x < lx2)
+					screen_nibble(row, shift, x, color);
+			}
+		}
+}
+
+/* Consecutive auto x+1 or auto y+1 pixel writes of the same layer and color, drawn as one fill. */
+
+static struct {
+	int shift, x, y, length, color, move;
+} pixel_span;
+
+static void
+screen_flush_pixels(void)
+{
+	int x2 = pixel_span.x + 1, y2 = pixel_span.y + 1;
+	if(!pixel_span.length)
+		return;
+	if(pixel_span.move & 0x1)
+		x2 = pixel_span.x + pixel_span.length;
+	else
+		y2 = pixel_span.y + pixel_span.length;
+	screen_fill(pixel_span.shift, pixel_span.x, pixel_span.y, x2, y2, pixel_span.color);
+	screen_change(pixel_span.x, pixel_span.y, x2, y2);
+	pixel_span.length = 0;
+}
+
+static void
+screen_pixel(int shift, Uint16 x, Uint16 y, int color, int move)
+{
+	int width = uxn_screen.width, height = uxn_screen.height;
+	if(move != 0x1 && move != 0x2) {
+		screen_flush_pixels();
+		if(x < width && y < height)
+			screen_put(shift, x, y, color);
+		screen_change(x, y, x + 1, y + 1);
+		return;
+	}
+	if(x >= width || y >= height)
+		return;
+	if(pixel_span.length && pixel_span.shift == shift && pixel_span.color == color && pixel_span.move == move &&
+		x == pixel_span.x + (move == 0x1 ? pixel_span.length : 0) &&
+		y == pixel_span.y + (move == 0x2 ? pixel_span.length : 0)) {
+		pixel_span.length++;
+		return;
+	}
+	screen_flush_pixels();
+	pixel_span.shift = shift;
+	pixel_span.x = x;
+	pixel_span.y = y;
+	pixel_span.color = color;
+	pixel_span.move = move;
+	pixel_span.length = 1;
+}
+
+static Uint32 lut_expand_8_32_f[256] = {
+#include "lut_expand_8_32_f.inc"
+};
+
+static Uint32 lut_expand_8_32_f_flipx[256] = {
+#include "lut_expand_8_32_f_flipx.inc"
+};
+
+/* Expands one sprite row into eight nibbles; *mask receives the pixels which get written. */
+static inline Uint32
+screen_sprite_row(Uint32 ch1, Uint32 ch2, Uint32 *colors, Uint32 opaque, Uint32 *mask)
+{
+	Uint32 both = ch1 & ch2, any = ch1 | ch2;
+	*mask = any | opaque;
+	return (colors[0] & ~any & opaque)
+		| (colors[1] & (ch1 ^ both))
+		| (colors[2] & (ch2 ^ both))
+		| (colors[3] & both);
+}
+
+/* Whole rows of eight pixels within one tile; the variants below pass twobpp and opaque as constants. */
+static inline __attribute__((always_inline)) void
+screen_blit_rows(Uint8 *dst, int nibble, Uint8 *ram, Uint16 addr, Uint32 *lut_expand, Uint32 *colors, Uint32 layer_mask, int flipy, int twobpp, int opaque)
+{
+	int v;
+	for(v = 0; v < 8; v++, dst += TILE_STRIDE) {
+		Uint32 mask;
+		Uint64 row;
+		Uint16 a = addr + (flipy ? 7 - v : v);
+		Uint32 ch1 = lut_expand[ram[a]];
+		Uint32 ch2 = twobpp ? lut_expand[ram[(a + 8) & 0xffff]] : 0;
+		Uint64 data = (Uint64)screen_sprite_row(ch1, ch2, colors, opaque ? 0xffffffff : 0, &mask) << nibble;
+		memcpy(&row, dst, sizeof(row));
+		row = (row & ~((Uint64)(mask & layer_mask) << nibble)) | data;
+		memcpy(dst, &row, sizeof(row));
+	}
+}
+
+typedef void (*ScreenBlitRows)(Uint8 *dst, int nibble, Uint8 *ram, Uint16 addr, Uint32 *lut_expand, Uint32 *colors, Uint32 layer_mask, int flipy);
+
+#define SCREEN_BLIT_ROWS(name, twobpp, opaque) \
+	static void name(Uint8 *dst, int nibble, Uint8 *ram, Uint16 addr, Uint32 *lut_expand, Uint32 *colors, Uint32 layer_mask, int flipy) \
+	{ screen_blit_rows(dst, nibble, ram, addr, lut_expand, colors, layer_mask, flipy, twobpp, opaque); }
+
+SCREEN_BLIT_ROWS(screen_blit_1bpp, 0, 0)
+SCREEN_BLIT_ROWS(screen_blit_1bpp_opaque, 0, 1)
+SCREEN_BLIT_ROWS(screen_blit_2bpp, 1, 0)
+SCREEN_BLIT_ROWS(screen_blit_2bpp_opaque, 1, 1)
+
+/* [twobpp][opaque] */
+static const ScreenBlitRows screen_blit_rows_table[2][2] = {
+	{screen_blit_1bpp, screen_blit_1bpp_opaque},
+	{screen_blit_2bpp, screen_blit_2bpp_opaque}};
+
+/* Draws count + 1 sprites, each one (dx, dy) away from the previous one. */
+static void
+screen_blit(int shift, Uint8 *ram, Uint16 addr, Uint16 addr_incr, int x1, int y1, int dx, int dy, int count, int color, int flipx, int flipy, int twobpp)
+{
+	int i, v, h, width = uxn_screen.width, height = uxn_screen.height;
+	int opaque = blending[4][color];
+	Uint32 *lut_expand = flipx ? lut_expand_8_32_f : lut_expand_8_32_f_flipx;
+	Uint32 colors[4], layer_mask = (0x3 << shift) * 0x11111111u;
+	ScreenBlitRows rows = screen_blit_rows_table[!!twobpp][!!opaque];
+	for(i = 0; i < 4; i++)
+		colors[i] = (blending[i][color] << shift) * 0x11111111u;
+	for(i = 0; i <= count; i++, x1 += dx, y1 += dy, addr += addr_incr) {
+		Uint16 x0 = x1, y0 = y1;
+		if(x0 <= width - 8 && y0 <= height - 8 && x0 % TILE_SIZE <= TILE_SIZE - 8 && y0 % TILE_SIZE <= TILE_SIZE - 8) {
+			/* whole rows of eight pixels within one tile, spanning five bytes when x is odd */
+			Uint8 *dst = screen_tile(x0, y0);
+			if(!dst)
+				continue;
+			dst += (x0 % TILE_SIZE >> 1) + (y0 % TILE_SIZE) * TILE_STRIDE;
+			rows(dst, (x0 & 1) << 2, ram, addr, lut_expand, colors, layer_mask, flipy);
+			continue;
+		}
+		for(v = 0; v < 8; v++) {
+			Uint16 c = ram[(addr + v) & 0xffff] | (twobpp ? (ram[(addr + v + 8) & 0xffff] << 8) : 0);
+			Uint16 y = y0 + (flipy ? 7 - v : v);
+			for(h = 7; h >= 0; --h, c >>= 1) {
+				Uint8 ch = (c & 1) | ((c >> 7) & 2);
+				if(opaque || ch) {
+					Uint16 x = x0 + (flipx ? 7 - h : h);
+					if(x < width && y < height)
+						screen_put(shift, x, y, blending[ch][color]);
+				}
 			}
 		}
 	}
@@ -72,49 +276,183 @@ screen_palette(Uint8 *addr)
 		uxn_screen.palette[i] = 0x0f000000 | r << 16 | g << 8 | b;
 		uxn_screen.palette[i] |= uxn_screen.palette[i] << 4;
 	}
+	/* only the output is recolored, the composed indices stay as they are */
 	screen_change(0, 0, uxn_screen.width, uxn_screen.height);
 }
 
 void
 screen_resize(Uint16 width, Uint16 height)
 {
-	Uint8 *bg, *fg;
 	Uint32 *pixels;
+	int tx, ty, y;
 	if(width < 0x8 || height < 0x8 || width >= 0x400 || height >= 0x400)
 		return;
-	bg = realloc(uxn_screen.bg, width * height),
-	fg = realloc(uxn_screen.fg, width * height);
+	screen_flush_pixels();
 	pixels = realloc(uxn_screen.pixels, width * height * sizeof(Uint32));
-	if(!bg || !fg || !pixels)
+	if(!pixels)
 		return;
-	uxn_screen.bg = bg;
-	uxn_screen.fg = fg;
 	uxn_screen.pixels = pixels;
 	uxn_screen.width = width;
 	uxn_screen.height = height;
-	screen_fill(uxn_screen.bg, 0, 0, uxn_screen.width, uxn_screen.height, 0);
-	screen_fill(uxn_screen.fg, 0, 0, uxn_screen.width, uxn_screen.height, 0);
+	/* keep what is still on screen, drop what fell off so that growing again shows color 0 */
+	for(ty = 0; ty < SCREEN_TILES; ty++)
+		for(tx = 0; tx < SCREEN_TILES; tx++) {
+			Uint8 *tile = uxn_screen.tiles[ty][tx];
+			int lx = width - tx * TILE_SIZE, ly = height - ty * TILE_SIZE;
+			if(!tile)
+				continue;
+			if(lx <= 0 || ly <= 0) {
+				screen_tile_release(&uxn_screen.tiles[ty][tx]);
+				continue;
+			}
+			if(ly < TILE_SIZE)
+				memset(tile + ly * TILE_STRIDE, 0, (TILE_SIZE - ly) * TILE_STRIDE);
+			if(lx < TILE_SIZE)
+				for(y = 0; y < ly && y < TILE_SIZE; y++) {
+					Uint8 *row = tile + y * TILE_STRIDE;
+					if(lx & 1)
+						row[lx >> 1] &= 0x0f;
+					memset(row + ((lx + 1) >> 1), 0, TILE_STRIDE - ((lx + 1) >> 1));
+				}
+		}
+	screen_change(0, 0, width, height);
 }
 
-void
+#if defined(__AVX2__)
+static inline void
+screen_redraw_32(Uint32 *dst, __m256i idx, __m256i p0, __m256i p1, __m256i p2, __m256i p3)
+{
+	__m256i c0 = _mm256_shuffle_epi8(p0, idx), c1 = _mm256_shuffle_epi8(p1, idx);
+	__m256i c2 = _mm256_shuffle_epi8(p2, idx), c3 = _mm256_shuffle_epi8(p3, idx);
+	__m256i lo01 = _mm256_unpacklo_epi8(c0, c1), hi01 = _mm256_unpackhi_epi8(c0, c1);
+	__m256i lo23 = _mm256_unpacklo_epi8(c2, c3), hi23 = _mm256_unpackhi_epi8(c2, c3);
+	__m256i q0 = _mm256_unpacklo_epi16(lo01, lo23), q1 = _mm256_unpackhi_epi16(lo01, lo23);
+	__m256i q2 = _mm256_unpacklo_epi16(hi01, hi23), q3 = _mm256_unpackhi_epi16(hi01, hi23);
+	/* unpacks stay within 128-bit lanes: put the halves back in pixel order */
+	_mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(q0, q1, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 8), _mm256_permute2x128_si256(q2, q3, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 16), _mm256_permute2x128_si256(q0, q1, 0x31));
+	_mm256_storeu_si256((__m256i *)(dst + 24), _mm256_permute2x128_si256(q2, q3, 0x31));
+}
+#elif defined(__SSSE3__)
+static inline void
+screen_redraw_16(Uint32 *dst, __m128i idx, __m128i p0, __m128i p1, __m128i p2, __m128i p3)
+{
+	__m128i c0 = _mm_shuffle_epi8(p0, idx), c1 = _mm_shuffle_epi8(p1, idx);
+	__m128i c2 = _mm_shuffle_epi8(p2, idx), c3 = _mm_shuffle_epi8(p3, idx);
+	__m128i lo01 = _mm_unpacklo_epi8(c0, c1), hi01 = _mm_unpackhi_epi8(c0, c1);
+	__m128i lo23 = _mm_unpacklo_epi8(c2, c3), hi23 = _mm_unpackhi_epi8(c2, c3);
+	_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(dst + 4), _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(dst + 8), _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i *)(dst + 12), _mm_unpackhi_epi16(hi01, hi23));
+}
+#endif
+
+/* Maps n packed indices starting at pixel x of a row to colors; planes[k][i] holds byte k of palette[i], for the shuffle kernels. */
+static void
+screen_redraw_span(Uint32 *dst, Uint8 *src, int x, int n, Uint32 *palette, Uint8 planes[4][16])
+{
+	int i = 0;
+	if(n > 0 && (x & 1)) {
+		*dst++ = palette[src[x >> 1] >> 4];
+		x++, n--;
+	}
+	src += x >> 1;
+#if defined(__AVX2__)
+	{
+		__m256i p0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)planes[0]));
+		__m256i p1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)planes[1]));
+		__m256i p2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)planes[2]));
+		__m256i p3 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)planes[3]));
+		__m256i nibble = _mm256_set1_epi8(0x0f);
+		for(; i + 64 <= n; i += 64) {
+			__m256i b = _mm256_loadu_si256((__m256i *)(src + (i >> 1)));
+			__m256i lo = _mm256_and_si256(b, nibble), hi = _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble);
+			__m256i u0 = _mm256_unpacklo_epi8(lo, hi), u1 = _mm256_unpackhi_epi8(lo, hi);
+			screen_redraw_32(dst + i, _mm256_permute2x128_si256(u0, u1, 0x20), p0, p1, p2, p3);
+			screen_redraw_32(dst + i + 32, _mm256_permute2x128_si256(u0, u1, 0x31), p0, p1, p2, p3);
+		}
+	}
+#elif defined(__SSSE3__)
+	{
+		__m128i p0 = _mm_loadu_si128((__m128i *)planes[0]), p1 = _mm_loadu_si128((__m128i *)planes[1]);
+		__m128i p2 = _mm_loadu_si128((__m128i *)planes[2]), p3 = _mm_loadu_si128((__m128i *)planes[3]);
+		__m128i nibble = _mm_set1_epi8(0x0f);
+		for(; i + 32 <= n; i += 32) {
+			__m128i b = _mm_loadu_si128((__m128i *)(src + (i >> 1)));
+			__m128i lo = _mm_and_si128(b, nibble), hi = _mm_and_si128(_mm_srli_epi16(b, 4), nibble);
+			screen_redraw_16(dst + i, _mm_unpacklo_epi8(lo, hi), p0, p1, p2, p3);
+			screen_redraw_16(dst + i + 16, _mm_unpackhi_epi8(lo, hi), p0, p1, p2, p3);
+		}
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	{
+		uint8x16_t p0 = vld1q_u8(planes[0]), p1 = vld1q_u8(planes[1]);
+		uint8x16_t p2 = vld1q_u8(planes[2]), p3 = vld1q_u8(planes[3]);
+		for(; i + 32 <= n; i += 32) {
+			uint8x16_t b = vld1q_u8(src + (i >> 1));
+			uint8x16x2_t idx = vzipq_u8(vandq_u8(b, vdupq_n_u8(0x0f)), vshrq_n_u8(b, 4));
+			int k;
+			for(k = 0; k < 2; k++) {
+				uint8x16x4_t c;
+				c.val[0] = vqtbl1q_u8(p0, idx.val[k]);
+				c.val[1] = vqtbl1q_u8(p1, idx.val[k]);
+				c.val[2] = vqtbl1q_u8(p2, idx.val[k]);
+				c.val[3] = vqtbl1q_u8(p3, idx.val[k]);
+				vst4q_u8((Uint8 *)(dst + i + k * 16), c);
+			}
+		}
+	}
+#else
+	(void)planes;
+#endif
+	for(; i + 1 < n; i += 2) {
+		Uint8 b = src[i >> 1];
+		dst[i] = palette[b & 0xf];
+		dst[i + 1] = palette[b >> 4];
+	}
+	if(i < n)
+		dst[i] = palette[src[i >> 1] & 0xf];
+}
+
+/* Returns whether any pixel was redrawn, so that unchanged frames need not be presented again. */
+int
 screen_redraw(void)
 {
-	Uint8 *fg = uxn_screen.fg, *bg = uxn_screen.bg;
+	Uint8 planes[4][16];
 	Uint32 palette[16], *pixels = uxn_screen.pixels;
-	int i, x, y, w = uxn_screen.width, h = uxn_screen.height;
-	int x1 = uxn_screen.x1;
-	int y1 = uxn_screen.y1;
-	int x2 = uxn_screen.x2 > w ? w : uxn_screen.x2;
-	int y2 = uxn_screen.y2 > h ? h : uxn_screen.y2;
-	for(i = 0; i < 16; i++)
+	int i, n, x, y, w = uxn_screen.width, h = uxn_screen.height;
+	int x1, y1, x2, y2;
+	screen_flush_pixels();
+	x1 = uxn_screen.x1;
+	y1 = uxn_screen.y1;
+	x2 = uxn_screen.x2 > w ? w : uxn_screen.x2;
+	y2 = uxn_screen.y2 > h ? h : uxn_screen.y2;
+	uxn_screen.x1 = uxn_screen.y1 = 0xffff;
+	uxn_screen.x2 = uxn_screen.y2 = 0;
+	if(x1 >= x2 || y1 >= y2)
+		return 0;
+	for(i = 0; i < 16; i++) {
 		palette[i] = uxn_screen.palette[(i >> 2) ? (i >> 2) : (i & 3)];
+		planes[0][i] = palette[i];
+		planes[1][i] = palette[i] >> 8;
+		planes[2][i] = palette[i] >> 16;
+		planes[3][i] = palette[i] >> 24;
+	}
 	for(y = y1; y < y2; y++)
-		for(x = x1; x < x2; x++) {
-			i = x + y * w;
-			pixels[i] = palette[fg[i] << 2 | bg[i]];
+		for(x = x1; x < x2; x = n) {
+			Uint8 *tile = uxn_screen.tiles[y / TILE_SIZE][x / TILE_SIZE];
+			Uint32 *dst = pixels + x + y * w;
+			n = (x / TILE_SIZE + 1) * TILE_SIZE;
+			if(n > x2) n = x2;
+			if(tile)
+				screen_redraw_span(dst, tile + (y % TILE_SIZE) * TILE_STRIDE, x % TILE_SIZE, n - x, palette, planes);
+			else
+				for(i = x; i < n; i++)
+					*dst++ = palette[0];
 		}
-	uxn_screen.x1 = uxn_screen.y1 = 0xffff;
-	uxn_screen.x2 = uxn_screen.y2 = 0;
+	return 1;
 }
 
 Uint8
@@ -144,35 +482,31 @@ screen_deo(Uint8 *ram, Uint8 *d, Uint8 port)
 		Uint8 color = ctrl & 0x3;
 		Uint16 x = PEEK2(d + 0x8);
 		Uint16 y = PEEK2(d + 0xa);
-		Uint8 *layer = (ctrl & 0x40) ? uxn_screen.fg : uxn_screen.bg;
+		int shift = (ctrl & 0x40) ? 2 : 0;
 		/* fill mode */
 		if(ctrl & 0x80) {
 			Uint16 x2 = uxn_screen.width;
 			Uint16 y2 = uxn_screen.height;
 			if(ctrl & 0x10) x2 = x, x = 0;
 			if(ctrl & 0x20) y2 = y, y = 0;
-			screen_fill(layer, x, y, x2, y2, color);
+			screen_flush_pixels();
+			screen_fill(shift, x, y, x2, y2, color);
 			screen_change(x, y, x2, y2);
 		}
 		/* pixel mode */
 		else {
-			Uint16 width = uxn_screen.width;
-			Uint16 height = uxn_screen.height;
-			if(x < width && y < height)
-				layer[x + y * width] = color;
-			screen_change(x, y, x + 1, y + 1);
+			screen_pixel(shift, x, y, color, d[0x6] & 0x3);
 			if(d[0x6] & 0x1) POKE2(d + 0x8, x + 1); /* auto x+1 */
 			if(d[0x6] & 0x2) POKE2(d + 0xa, y + 1); /* auto y+1 */
 		}
 		break;
 	}
 	case 0xf: {
-		Uint8 i;
 		Uint8 ctrl = d[0xf];
 		Uint8 move = d[0x6];
 		Uint8 length = move >> 4;
 		Uint8 twobpp = !!(ctrl & 0x80);
-		Uint8 *layer = (ctrl & 0x40) ? uxn_screen.fg : uxn_screen.bg;
+		int shift = (ctrl & 0x40) ? 2 : 0;
 		Uint8 color = ctrl & 0xf;
 		Uint16 x = PEEK2(d + 0x8), dx = (move & 0x1) << 3;
 		Uint16 y = PEEK2(d + 0xa), dy = (move & 0x2) << 2;
@@ -180,11 +514,13 @@ screen_deo(Uint8 *ram, Uint8 *d, Uint8 port)
 		int flipx = (ctrl & 0x10), fx = flipx ? -1 : 1;
 		int flipy = (ctrl & 0x20), fy = flipy ? -1 : 1;
 		Uint16 dyx = dy * fx, dxy = dx * fy;
-		for(i = 0; i <= length; i++) {
-			screen_blit(layer, ram, addr, x + dyx * i, y + dxy * i, color, flipx, flipy, twobpp);
-			addr += addr_incr;
-		}
-		screen_change(x, y, x + dyx * length + 8, y + dxy * length + 8);
+		screen_flush_pixels();
+		screen_blit(shift, ram, addr, addr_incr, x, y, dyx, dxy, length, color, flipx, flipy, twobpp);
+		addr += addr_incr * (length + 1);
+		/* flipped strips extend left/up from the start position */
+		int sx = (Sint16)(flipx ? x + dyx * length : x);
+		int sy = (Sint16)(flipy ? y + dxy * length : y);
+		screen_change(sx, sy, sx + dy * length + 8, sy + dx * length + 8);
 		if(move & 0x1) POKE2(d + 0x8, x + dx * fx); /* auto x+8 */
 		if(move & 0x2) POKE2(d + 0xa, y + dy * fy); /* auto y+8 */
 		if(move & 0x4) POKE2(d + 0xc, addr);        /* auto addr+length */
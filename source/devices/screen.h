@@ -10,15 +10,17 @@ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
 WITH REGARD TO THIS SOFTWARE.
 */
 
+#define SCREEN_TILES 16 /* of 64x64 pixels per axis, up to 1024x1024 */
+
 typedef struct UxnScreen {
 	int width, height, x1, y1, x2, y2;
 	Uint32 palette[4], *pixels;
-	Uint8 *fg, *bg;
+	Uint8 *tiles[SCREEN_TILES][SCREEN_TILES]; /* fg << 2 | bg per pixel, two pixels per byte; NULL until drawn to */
 } UxnScreen;
 
 extern UxnScreen uxn_screen;
 void screen_palette(Uint8 *addr);
 void screen_resize(Uint16 width, Uint16 height);
-void screen_redraw(void);
+int screen_redraw(void);
 Uint8 screen_dei(Uxn *u, Uint8 addr);
 void screen_deo(Uint8 *ram, Uint8 *d, Uint8 port);
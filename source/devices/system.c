@@ -133,6 +133,7 @@ uxn_halt(Uxn *u, Uint8 instr, Uint8 err, Uint16 addr)
 		u->wst.dat[3] = err;
 		return uxn_eval(u, handler);
 	} else {
+		console_flush();
 		system_inspect(u);
 		iprintf("%s %s, by %02x at 0x%04x.\n", (instr & 0x40) ? "Return-stack" : "Working-stack", errors[err - 1], instr, addr);
 	}
@@ -141,23 +142,51 @@ uxn_halt(Uxn *u, Uint8 instr, Uint8 err, Uint16 addr)
 
 /* Console */
 
+#define CONSOLE_BUFFER 0x100
+
+/* Bytes written to ports 0x8 and 0x9, held until a newline, a full buffer or
+console_flush. Both go to stdout, which is the console on the NDS and 3DS. */
+static char console_buf[2][CONSOLE_BUFFER];
+static int console_len[2];
+
+static void
+console_write(int i)
+{
+	fwrite(console_buf[i], 1, console_len[i], stdout);
+	fflush(stdout);
+	console_len[i] = 0;
+}
+
+void
+console_flush(void)
+{
+	if(console_len[0]) console_write(0);
+	if(console_len[1]) console_write(1);
+}
+
 int
 console_input(Uxn *u, char c, int type)
 {
 	Uint8 *d = &u->dev[0x10];
+	int ret;
 	d[0x2] = c;
 	d[0x7] = type;
-	return uxn_eval(u, PEEK2(d));
+	ret = uxn_eval(u, PEEK2(d));
+	console_flush();
+	return ret;
 }
 
 void
 console_deo(Uint8 *d, Uint8 port)
 {
+	int i;
 	switch(port) {
 	case 0x8:
 	case 0x9:
-		fputc(d[port], stdout);
-		fflush(stdout);
+		i = port - 0x8;
+		console_buf[i][console_len[i]++] = d[port];
+		if(d[port] == '\n' || console_len[i] == CONSOLE_BUFFER)
+			console_write(i);
 		return;
 	}
 }
@@ -0,0 +1,286 @@
+#include <time.h>
+#include <unistd.h>
+#include "uxn.h"
+#include "devices/audio.h"
+#include "devices/datetime.h"
+#include "devices/file.h"
+#include "devices/screen.h"
+#include "devices/system.h"
+
+/*
+Copyright (c) 2021 Devine Lu Linvega
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Headless runner for the development machine, built by Makefile.host. It runs
+a ROM with the generic screen and audio devices: the arguments after the ROM
+and then stdin through the console vector, as uxncli does, then as many
+frames of the screen vector as asked for, as fast as it can, and can record
+what is presented.
+*/
+
+#define PPU_PIXELS_WIDTH 256
+#define PPU_PIXELS_HEIGHT 192
+#define FRAME_RATE 60
+#define CONSOLE_READ 0x10000 /* bytes of stdin read at once */
+
+Uxn u;
+
+static Uint32 audio_frames; /* mixed so far, the output clock */
+static Sint16 *audio_buffer;
+
+static FILE *frames_file, *frames_times;
+static int frames_width, frames_height, frames_stopped;
+static Uint32 frames_written;
+
+static double
+host_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+error(char *msg, const char *err)
+{
+	fprintf(stderr, "Error %s: %s\n", msg, err);
+	return 0;
+}
+
+void
+audio_finished_handler(int instance)
+{
+
+}
+
+Uint32
+audio_clock(void)
+{
+	return audio_frames;
+}
+
+/* Devices */
+
+static Uint8 host_system_dei(Uint8 *d, Uint8 port) { return system_dei(&u, port); }
+
+static void
+host_system_deo(Uint8 *d, Uint8 port)
+{
+	system_deo(&u, d, port);
+	if(port > 0x7 && port < 0xe)
+		screen_palette(&u.dev[0x8]);
+}
+
+static Uint8 host_screen_dei(Uint8 *d, Uint8 port) { return screen_dei(&u, 0x20 + port); }
+static void host_screen_deo(Uint8 *d, Uint8 port) { screen_deo(u.ram.dat, d, port); }
+
+static Uint8
+audio_dei(int instance, Uint8 *d, Uint8 port)
+{
+	switch(port) {
+	case 0x4: return audio_get_vu(instance);
+	case 0x2: POKE2(d + 0x2, audio_get_position(instance)); /* fall through */
+	default: return d[port];
+	}
+}
+
+static void
+audio_deo(int instance, Uint8 *d, Uint8 port)
+{
+	if(port == 0xf)
+		audio_start(instance, d, &u);
+}
+
+static Uint8 audio0_dei(Uint8 *d, Uint8 port) { return audio_dei(0, d, port); }
+static Uint8 audio1_dei(Uint8 *d, Uint8 port) { return audio_dei(1, d, port); }
+static Uint8 audio2_dei(Uint8 *d, Uint8 port) { return audio_dei(2, d, port); }
+static Uint8 audio3_dei(Uint8 *d, Uint8 port) { return audio_dei(3, d, port); }
+static void audio0_deo(Uint8 *d, Uint8 port) { audio_deo(0, d, port); }
+static void audio1_deo(Uint8 *d, Uint8 port) { audio_deo(1, d, port); }
+static void audio2_deo(Uint8 *d, Uint8 port) { audio_deo(2, d, port); }
+static void audio3_deo(Uint8 *d, Uint8 port) { audio_deo(3, d, port); }
+static void file0_deo(Uint8 *d, Uint8 port) { file_deo(&u, 0xa0 + port); }
+static void file1_deo(Uint8 *d, Uint8 port) { file_deo(&u, 0xb0 + port); }
+
+/* Recording */
+
+/*
+Frames are written raw, in ffmpeg's bgra pixel format, and only when
+screen_redraw found something to redraw. The time of each one goes to
+<file>.txt in milliseconds, in the "timestamp format v2" that mkvmerge
+--timestamps reads, to put them back at their real times.
+*/
+static int
+frames_open(char *path)
+{
+	char times[MAX_PATH];
+	snprintf(times, sizeof(times), "%s.txt", path);
+	if(!(frames_file = fopen(path, "wb")) || !(frames_times = fopen(times, "w")))
+		return error("Record", path);
+	fputs("# timestamp format v2\n", frames_times);
+	return 1;
+}
+
+static void
+frames_write(Uint32 frame)
+{
+	if(!frames_written) {
+		frames_width = uxn_screen.width, frames_height = uxn_screen.height;
+		fprintf(stderr, "%d x %d bgra frames\n", frames_width, frames_height);
+	} else if(uxn_screen.width != frames_width || uxn_screen.height != frames_height) {
+		fprintf(stderr, "screen resized to %d x %d, recording stopped\n", uxn_screen.width, uxn_screen.height);
+		frames_stopped = 1;
+		return;
+	}
+	fwrite(uxn_screen.pixels, 4, frames_width * frames_height, frames_file);
+	fprintf(frames_times, "%u\n", frame * 1000 / FRAME_RATE);
+	frames_written++;
+}
+
+/* Main */
+
+static int
+halted(void)
+{
+	return u.dev[0x0f] != 0;
+}
+
+/* Console */
+
+static void
+console_arguments(int argc, char **argv)
+{
+	int i;
+	for(i = 0; i < argc && !halted(); i++) {
+		char *p = argv[i];
+		while(*p && !halted())
+			console_input(&u, *p++, CONSOLE_ARG);
+		console_input(&u, '\n', i == argc - 1 ? CONSOLE_END : CONSOLE_EOA);
+	}
+}
+
+/*
+Feeds stdin to the console vector a byte at a time, read in large blocks,
+then ends it; returns the bytes fed. Unlike console_input, output is only
+flushed once per block, beyond the lines console_deo writes as they end.
+*/
+static long
+console_stream(void)
+{
+	static Uint8 buf[CONSOLE_READ];
+	Uint8 *d = &u.dev[0x10];
+	long total = 0;
+	ssize_t n, i;
+	while(!halted() && (n = read(0, buf, sizeof(buf))) > 0) {
+		for(i = 0; i < n && !halted(); i++, total++) {
+			d[0x2] = buf[i];
+			d[0x7] = CONSOLE_STD;
+			uxn_eval(&u, PEEK2(d));
+		}
+		console_flush();
+	}
+	if(!halted())
+		console_input(&u, 0x00, CONSOLE_END);
+	return total;
+}
+
+/* The frame loop of the other frontends, without input and without waiting for a display. */
+static Uint32
+run_frames(Uint32 frames)
+{
+	Uint32 frame, frame_audio = audio_get_rate() / FRAME_RATE;
+	for(frame = 0; frame < frames && !halted(); frame++) {
+		audio_frame(frame_audio);
+		uxn_eval(&u, GETVEC(u.dev + 0x20));
+		console_flush();
+		audio_flush();
+		audio_mix(audio_buffer, frame_audio);
+		audio_frames += frame_audio;
+		if(screen_redraw() && frames_file && !frames_stopped)
+			frames_write(frame);
+	}
+	return frame;
+}
+
+static int
+usage(char *name)
+{
+	fprintf(stderr, "usage: %s [-n frames] [-f frames.raw] rom [args...]\n", name);
+	return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	Uint32 frames = 0, run;
+	double start, elapsed;
+	long streamed = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "n:f:")) != -1) {
+		switch(opt) {
+		case 'n': frames = strtoul(optarg, NULL, 0); break;
+		case 'f': if(!frames_open(optarg)) return 1; break;
+		default: return usage(argv[0]);
+		}
+	}
+	if(optind >= argc)
+		return usage(argv[0]);
+
+	uxn_register_device(0x0, host_system_dei, host_system_deo);
+	uxn_register_device(0x1, NULL, console_deo);
+	uxn_register_device(0x2, host_screen_dei, host_screen_deo);
+	uxn_register_device(0x3, audio0_dei, audio0_deo);
+	uxn_register_device(0x4, audio1_dei, audio1_deo);
+	uxn_register_device(0x5, audio2_dei, audio2_deo);
+	uxn_register_device(0x6, audio3_dei, audio3_deo);
+	uxn_register_device(0xa, NULL, file0_deo);
+	uxn_register_device(0xb, NULL, file1_deo);
+	uxn_register_device(0xc, datetime_dei, NULL);
+
+	if(!uxn_boot())
+		return !error("Boot", "Failed");
+	if(!system_load(&u, argv[optind]))
+		return !error("Load", argv[optind]);
+	if(!(audio_buffer = malloc(audio_get_rate() / FRAME_RATE * 4)))
+		return !error("Audio", "Out of memory");
+	screen_resize(PPU_PIXELS_WIDTH, PPU_PIXELS_HEIGHT);
+
+	u.dev[0x17] = argc - optind > 1;
+	uxn_eval(&u, PAGE_PROGRAM);
+	console_flush();
+	if(argc - optind > 1) {
+		start = host_time();
+		console_arguments(argc - optind - 1, argv + optind + 1);
+		fprintf(stderr, "%d arguments in %.2f s\n", argc - optind - 1, host_time() - start);
+	}
+	/* a terminal is left alone, so that screen ROMs with a console vector still start */
+	if(PEEK2(u.dev + 0x10) && !isatty(0)) {
+		start = host_time();
+		streamed = console_stream();
+		elapsed = host_time() - start;
+		if(streamed)
+			fprintf(stderr, "%ld bytes of stdin in %.2f s, %.2f MB/s\n", streamed, elapsed, streamed / elapsed / 1e6);
+	}
+
+	start = host_time();
+	run = run_frames(frames);
+	elapsed = host_time() - start;
+
+	if(run)
+		fprintf(stderr, "%u frames in %.2f s, %.1f frames/s\n", run, elapsed, run / elapsed);
+	if(frames_file) {
+		fclose(frames_file);
+		fclose(frames_times);
+		fprintf(stderr, "%u frames written, %.1f frames/s\n", frames_written, frames_written / elapsed);
+	}
+	return u.dev[0x0f] & 0x7f;
+}
@@ -0,0 +1,193 @@
+#include "../uxn.h"
+
+/*
+Copyright (c) 2021 Devine Lu Linvega
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Portable interpreter behind the API of uxngba-c.c, for the host runner. It
+follows uxngba.s: no stack or division errors (x / 0 is 0), and a DEO2 or
+DEI2 calls the device once for each of its two ports.
+*/
+
+static Uint8 wst[0x100], rst[0x100], wst_ptr, rst_ptr;
+static Uint8 device_data[0x100];
+Uint8 uxn_ram[0x10000 * RAM_PAGES];
+
+static void deo_stub(Uint8 *d, Uint8 port) { (void)d, (void)port; }
+static Uint8 dei_stub(Uint8 *d, Uint8 port) { return d[port]; }
+
+static uxn_deo_t deo_map[16] = {
+	deo_stub, deo_stub, deo_stub, deo_stub, deo_stub, deo_stub, deo_stub, deo_stub,
+	deo_stub, deo_stub, deo_stub, deo_stub, deo_stub, deo_stub, deo_stub, deo_stub};
+static uxn_dei_t dei_map[16] = {
+	dei_stub, dei_stub, dei_stub, dei_stub, dei_stub, dei_stub, dei_stub, dei_stub,
+	dei_stub, dei_stub, dei_stub, dei_stub, dei_stub, dei_stub, dei_stub, dei_stub};
+
+int
+resetuxn(void)
+{
+	memset(wst, 0, sizeof(wst));
+	memset(rst, 0, sizeof(rst));
+	wst_ptr = rst_ptr = 0;
+	memset(device_data, 0, sizeof(device_data));
+	memset(uxn_ram, 0, sizeof(uxn_ram));
+	return 1;
+}
+
+int
+uxn_boot(void)
+{
+	u.wst.dat = wst;
+	u.rst.dat = rst;
+	u.dev = device_data;
+	u.ram.dat = uxn_ram;
+	return resetuxn();
+}
+
+static Uint8
+dei(Uint8 port)
+{
+	return dei_map[port >> 4](device_data + (port & 0xf0), port & 0xf);
+}
+
+static void
+deo(Uint8 port, Uint8 value)
+{
+	device_data[port] = value;
+	deo_map[port >> 4](device_data + (port & 0xf0), port & 0xf);
+}
+
+/* The stack an instruction works on, and the other one; in keep mode pops only move a copy of the pointer. */
+#define POP8() (s[--*sp])
+#define POP16() (b = s[--*sp], b | s[--*sp] << 8)
+#define POP() (w ? POP16() : POP8())
+#define PUSH8(v) { s[(*dp)++] = (v); }
+#define PUSH16(v) { Uint16 v_ = (v); s[(*dp)++] = v_ >> 8; s[(*dp)++] = v_; }
+#define PUSH(v) { if(w) PUSH16(v) else PUSH8(v) }
+#define JUMP(a) { pc = w ? (a) : pc + (Sint8)(a); }
+
+int
+uxn_eval(Uxn *u, Uint32 vec)
+{
+	Uint8 *ram = uxn_ram, *s, *o, *sp, *dp, *op, kp;
+	Uint16 pc = vec, a, b, c;
+	int w;
+	if(!pc)
+		return 0;
+	for(;;) {
+		Uint8 instr = ram[pc++];
+		switch(instr) {
+		case 0x00: return 1;
+		case 0x20: /* JCI */
+			a = PEEK2(ram + pc), pc += 2;
+			if(wst[--wst_ptr]) pc += a;
+			continue;
+		case 0x40: /* JMI */
+			a = PEEK2(ram + pc), pc += 2 + a;
+			continue;
+		case 0x60: /* JSI */
+			a = PEEK2(ram + pc), pc += 2;
+			rst[rst_ptr++] = pc >> 8, rst[rst_ptr++] = pc;
+			pc += a;
+			continue;
+		case 0x80: wst[wst_ptr++] = ram[pc++]; continue;
+		case 0xa0: wst[wst_ptr++] = ram[pc++], wst[wst_ptr++] = ram[pc++]; continue;
+		case 0xc0: rst[rst_ptr++] = ram[pc++]; continue;
+		case 0xe0: rst[rst_ptr++] = ram[pc++], rst[rst_ptr++] = ram[pc++]; continue;
+		}
+		w = instr & 0x20;
+		if(instr & 0x40)
+			s = rst, dp = &rst_ptr, o = wst, op = &wst_ptr;
+		else
+			s = wst, dp = &wst_ptr, o = rst, op = &rst_ptr;
+		kp = *dp;
+		sp = (instr & 0x80) ? &kp : dp;
+		switch(instr & 0x1f) {
+		case 0x01: a = POP(); PUSH(a + 1); break;
+		case 0x02: POP(); break;
+		case 0x03: a = POP(); POP(); PUSH(a); break;
+		case 0x04: a = POP(); b = POP(); PUSH(a); PUSH(b); break;
+		case 0x05: { Uint16 x = POP(), y = POP(), z = POP(); PUSH(y); PUSH(x); PUSH(z); } break;
+		case 0x06: a = POP(); PUSH(a); PUSH(a); break;
+		case 0x07: { Uint16 x = POP(), y = POP(); PUSH(y); PUSH(x); PUSH(y); } break;
+		case 0x08: { Uint16 x = POP(), y = POP(); PUSH8(y == x); } break;
+		case 0x09: { Uint16 x = POP(), y = POP(); PUSH8(y != x); } break;
+		case 0x0a: { Uint16 x = POP(), y = POP(); PUSH8(y > x); } break;
+		case 0x0b: { Uint16 x = POP(), y = POP(); PUSH8(y < x); } break;
+		case 0x0c: a = POP(); JUMP(a); break;
+		case 0x0d: a = POP(); if(POP8()) JUMP(a); break;
+		case 0x0e: a = POP(); o[(*op)++] = pc >> 8, o[(*op)++] = pc; JUMP(a); break;
+		case 0x0f:
+			a = POP();
+			if(w) o[(*op)++] = a >> 8;
+			o[(*op)++] = a;
+			break;
+		case 0x10: a = POP8(); PUSH8(ram[a]); if(w) PUSH8(ram[a + 1]); break;
+		case 0x11: a = POP8(); c = POP(); if(w) ram[a] = c >> 8, ram[a + 1] = c; else ram[a] = c; break;
+		case 0x12: a = pc + (Sint8)POP8(); PUSH8(ram[a]); if(w) PUSH8(ram[(Uint16)(a + 1)]); break;
+		case 0x13: a = pc + (Sint8)POP8(); c = POP(); if(w) ram[a] = c >> 8, ram[(Uint16)(a + 1)] = c; else ram[a] = c; break;
+		case 0x14: a = POP16(); PUSH8(ram[a]); if(w) PUSH8(ram[(Uint16)(a + 1)]); break;
+		case 0x15: a = POP16(); c = POP(); if(w) ram[a] = c >> 8, ram[(Uint16)(a + 1)] = c; else ram[a] = c; break;
+		case 0x16: a = POP8(); PUSH8(dei(a)); if(w) PUSH8(dei(a + 1)); break;
+		case 0x17:
+			a = POP8(), c = POP();
+			if(w) {
+				device_data[(Uint8)(a + 1)] = c;
+				deo(a, c >> 8);
+				deo(a + 1, c);
+			} else
+				deo(a, c);
+			break;
+		case 0x18: { Uint16 x = POP(), y = POP(); PUSH(y + x); } break;
+		case 0x19: { Uint16 x = POP(), y = POP(); PUSH(y - x); } break;
+		case 0x1a: { Uint16 x = POP(), y = POP(); PUSH(y * x); } break;
+		case 0x1b: { Uint16 x = POP(), y = POP(); PUSH(x ? y / x : 0); } break;
+		case 0x1c: { Uint16 x = POP(), y = POP(); PUSH(y & x); } break;
+		case 0x1d: { Uint16 x = POP(), y = POP(); PUSH(y | x); } break;
+		case 0x1e: { Uint16 x = POP(), y = POP(); PUSH(y ^ x); } break;
+		case 0x1f: { Uint8 x = POP8(); Uint16 y = POP(); PUSH((y >> (x & 0xf)) << (x >> 4)); } break;
+		}
+	}
+}
+
+int
+uxn_get_wst_ptr(void)
+{
+	return wst_ptr;
+}
+
+int
+uxn_get_rst_ptr(void)
+{
+	return rst_ptr;
+}
+
+void
+uxn_set_wst_ptr(int value)
+{
+	wst_ptr = value;
+}
+
+void
+uxn_set_rst_ptr(int value)
+{
+	rst_ptr = value;
+}
+
+void
+uxn_register_device(int id, uxn_dei_t dei, uxn_deo_t deo)
+{
+	if(dei != NULL)
+		dei_map[id] = dei;
+	if(deo != NULL)
+		deo_map[id] = deo;
+}
@@ -21,7 +21,7 @@ WITH REGARD TO THIS SOFTWARE.
 #define dbgprintf(...)
 #endif
 
-#ifdef __BLOCKSDS__
+#if defined(__BLOCKSDS__) || defined(UXN_HOST)
 #define iprintf printf
 #define siprintf sprintf
 #define sniprintf snprintf
@@ -40,6 +40,7 @@ typedef int8_t Sint8;
 typedef uint16_t Uint16;
 typedef int16_t Sint16;
 typedef unsigned int Uint32;
+typedef uint64_t Uint64;
 
 #define PAGE_PROGRAM 0x0100
 #define RAM_PAGES 0x0F
@@ -0,0 +1,210 @@
+#include <pthread.h>
+#include "devices/audio.c"
+#include "test.h"
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Tests of the audio device ports as the VM reads them while another thread
+mixes, as on the 3DS where the mixer runs in the ndsp callback. Built with
+the thread sanitizer, see Makefile.host. --bench prints what mixing costs at
+each output rate.
+*/
+
+#define BLOCK 256
+
+Uxn u;
+static Uint8 ram[0x10000], dev[POLYPHONY][0x10];
+static Uint32 clock_now, finished[POLYPHONY];
+
+void
+audio_finished_handler(int instance)
+{
+	finished[instance]++;
+}
+
+Uint32
+audio_clock(void)
+{
+	return __atomic_load_n(&clock_now, __ATOMIC_RELAXED);
+}
+
+static void
+mix(Sint16 *sample, int frames)
+{
+	audio_mix(sample, frames);
+	__atomic_fetch_add(&clock_now, frames, __ATOMIC_RELAXED);
+}
+
+/* Starts a note on instance as a DEO to its pitch port would, to be queued by audio_flush. */
+static void
+note_on(int instance, Uint16 adsr, Uint16 addr, Uint16 len, Uint8 volume, Uint8 pitch)
+{
+	Uint8 *d = dev[instance];
+	POKE2(d + 0x8, adsr);
+	POKE2(d + 0xa, len);
+	POKE2(d + 0xc, addr);
+	d[0x5] = 0;
+	d[0xe] = volume;
+	d[0xf] = pitch;
+	audio_start(instance, d, &u);
+}
+
+/*
+Plays a repeating note until its envelope ends it; returns a checksum of the
+output, reading the ports between blocks if asked. The blocks divide the
+envelope's steps, so a read falls on the very frame the note ends.
+*/
+static Uint32
+play_note(int read_ports, int *peak_vu)
+{
+	Sint16 buffer[60 * 2];
+	Uint32 sum = 0;
+	int i, k;
+	audio_frame(0);
+	note_on(0, 0x1001, 0x1000, 0x800, 0xff, 48);
+	audio_flush();
+	for(k = 0; k < 200; k++) {
+		mix(buffer, 60);
+		for(i = 0; i < 60 * 2; i++)
+			sum = sum * 31 + buffer[i];
+		if(read_ports)
+			for(i = 0; i < 100; i++) {
+				Uint8 vu = audio_get_vu(0);
+				if(vu > *peak_vu) *peak_vu = vu;
+				audio_get_position(0);
+			}
+	}
+	return sum;
+}
+
+/* Reading the VU and position changes nothing: the same output, and the note still reports its end. */
+static void
+test_ports_read_only(void)
+{
+	int peak = 0;
+	Uint32 quiet, read;
+	finished[0] = 0;
+	quiet = play_note(0, &peak);
+	CHECK(finished[0] == 1, "note ended %u times without reads", finished[0]);
+	read = play_note(1, &peak);
+	CHECK(finished[0] == 2, "note ended %u times with reads", finished[0] - 1);
+	CHECK(quiet == read, "reading the ports changed the output");
+	CHECK(peak == 0xff, "peak VU %02x, not ff", peak);
+	CHECK(audio_get_vu(0) == 0, "VU %02x after the note ended", audio_get_vu(0));
+}
+
+static volatile int mixer_stop;
+
+static void *
+mixer_thread(void *arg)
+{
+	static Sint16 buffer[BLOCK * 2];
+	while(!__atomic_load_n(&mixer_stop, __ATOMIC_RELAXED))
+		mix(buffer, BLOCK);
+	return NULL;
+}
+
+/* The VM side starts notes and reads the ports as fast as it can while the mixer thread runs. */
+static void
+test_ports_threads(void)
+{
+	pthread_t mixer;
+	int frame, i, moved = 0, loud = 0;
+	Uint16 last = 0;
+	mixer_stop = 0;
+	if(pthread_create(&mixer, NULL, mixer_thread, NULL)) {
+		CHECK(0, "cannot start the mixer thread");
+		return;
+	}
+	for(frame = 0; frame < 2000; frame++) {
+		audio_frame(BLOCK);
+		if(test_rand() % 2) {
+			Uint16 len = 0x10 + test_rand() % 0x1000;
+			note_on(test_rand() % POLYPHONY, test_rand() % 2 ? test_rand() : 0, test_rand() % (0x10000 - len), len,
+				test_rand(), test_rand() % 0x100);
+		}
+		audio_flush();
+		for(i = 0; i < 1000; i++) {
+			Uint8 vu = audio_get_vu(i % POLYPHONY);
+			Uint16 position = audio_get_position(0);
+			loud += vu != 0;
+			moved += position != last;
+			last = position;
+		}
+	}
+	__atomic_store_n(&mixer_stop, 1, __ATOMIC_RELAXED);
+	pthread_join(mixer, NULL);
+	CHECK(loud, "the VU never moved");
+	CHECK(moved, "the position never moved");
+}
+
+/* Stops every voice with a note out of range. */
+static void
+stop_all(void)
+{
+	Sint16 buffer[BLOCK * 2];
+	int i;
+	for(i = 0; i < POLYPHONY; i++)
+		note_on(i, 0, 0, 0, 0, 0x7f);
+	audio_flush();
+	mix(buffer, BLOCK);
+}
+
+/*
+Ten minutes of four voices retriggered every quarter second, two sampled and
+two single cycle, mixed a frame at a time as the frontends do at each rate.
+*/
+static void
+bench_rates(void)
+{
+	static Uint32 rates[] = {11025, 16000, 22050, 32000, 44100};
+	static Sint16 buffer[44100 / 60 * 2];
+	int r, i, frame, seconds = 600;
+	printf("%8s %10s %12s %12s\n", "rate", "mix s", "% of a core", "ns / frame");
+	for(r = 0; r < (int)(sizeof(rates) / sizeof(*rates)); r++) {
+		Uint32 n = rates[r] / 60;
+		double start, elapsed;
+		stop_all();
+		audio_set_rate(rates[r]);
+		start = test_time();
+		for(frame = 0; frame < seconds * 60; frame++) {
+			audio_frame(n);
+			if(frame % 15 == 0)
+				for(i = 0; i < POLYPHONY; i++)
+					note_on(i, 0x2244, 0x1000 * i, i < 2 ? 0x1000 : 0x40, 0x88, 36 + (frame / 15 + i * 7) % 48);
+			audio_flush();
+			mix(buffer, n);
+		}
+		elapsed = test_time() - start;
+		printf("%8u %10.3f %12.3f %12.1f\n", rates[r], elapsed, elapsed / seconds * 100,
+			elapsed / (seconds * 60.0 * n) * 1e9);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int i;
+	if(!test_init(argc, argv))
+		return 0;
+	for(i = 0; i < 0x10000; i++)
+		ram[i] = test_rand();
+	u.ram.dat = ram;
+	if(test_bench) {
+		bench_rates();
+		return 0;
+	}
+	test_ports_read_only();
+	test_ports_threads();
+	return test_exit("audio");
+}
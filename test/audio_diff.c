@@ -0,0 +1,357 @@
+#include <math.h>
+#include "uxn.h"
+#include "devices/audio.h"
+#undef SAMPLE_FREQUENCY
+#undef POLYPHONY
+#include "nds/apu.h"
+#include "test.h"
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Differential test of the two synths: the generic audio.c, and the NDS one
+split between arm9/source/nds_apu.c, which starts voices, and
+arm7/source/apu.c, which renders them. The same stream of audio device
+writes, pairs of port and value as the VM's DEOs, is replayed into each of
+them, a frame of samples is mixed after each frame and the outputs are
+compared sample by sample.
+
+Ports 0x30 to 0x6f are the four voices; a write to port 0x00 ends a frame.
+Both mix at 22050 Hz, and the notes of a frame start on the first sample
+mixed after it, so the timing of the frontends does not come into it. Notes
+shorter than 0x100 bytes which repeat are single cycle waveforms, which
+audio.c plays from a resampled cycle: those drift out of phase with the NDS
+and are only reported, every other note must come out the same.
+
+Streams are generated at random, or read with --stream <file>. --bench
+prints the stereo frames each synth mixes per second for one to four voices.
+*/
+
+#define RATE 22050
+#define FRAME (RATE / 60)
+#define VOICES 4
+
+typedef struct {
+	Uint8 port, value;
+} AudioWrite;
+
+typedef struct {
+	char *name;
+	void (*deo)(int instance, Uint8 *d, Uint8 port);
+	void (*mix)(Sint16 *sample, int frames);
+	Uint8 dev[VOICES][0x10];
+	Sint16 *out;
+	double time;
+} Synth;
+
+Uxn u;
+static Uint8 ram[0x10000];
+static Uint32 clock_now;
+
+/* generic */
+
+void
+audio_finished_handler(int instance)
+{
+}
+
+Uint32
+audio_clock(void)
+{
+	return clock_now;
+}
+
+static void
+generic_deo(int instance, Uint8 *d, Uint8 port)
+{
+	if(port == 0xf)
+		audio_start(instance, d, &u);
+}
+
+/* The frame loop of the frontends: notes queued during a frame play from the next block. */
+static void
+generic_mix(Sint16 *sample, int frames)
+{
+	audio_flush();
+	audio_mix(sample, frames);
+	clock_now += frames;
+	audio_frame(frames);
+}
+
+/* NDS: the audio port decoding of arm9/source/emulator.c and the mixing of arm7/source/main.c */
+
+static NdsApu nds_started[VOICES], nds_voices[VOICES];
+static Uint8 nds_pending, nds_active;
+static Sint32 nds_left[FRAME * 16], nds_right[FRAME * 16];
+
+static void
+nds_deo(int instance, Uint8 *d, Uint8 port)
+{
+	NdsApu *c = &nds_started[instance];
+	Uint16 addr = PEEK2(d + 0xc);
+	if(port != 0xf)
+		return;
+	c->len = PEEK2(d + 0xa);
+	if(c->len > 0x10000 - addr)
+		c->len = 0x10000 - addr;
+	c->addr = &ram[addr];
+	c->volume[0] = d[0xe] >> 4;
+	c->volume[1] = d[0xe] & 0xf;
+	c->repeat = !(d[0xf] & 0x80);
+	nds_apu_start(c, PEEK2(d + 0x8), d[0xf] & 0x7f, d[0x5]);
+	nds_pending |= 1 << instance;
+}
+
+static Sint16
+clamp16(Sint32 v)
+{
+	return v > 0x7fff ? 0x7fff : v < -0x8000 ? -0x8000 : v;
+}
+
+static void
+nds_mix(Sint16 *sample, int frames)
+{
+	int i;
+	for(i = 0; i < VOICES; i++)
+		if(nds_pending & (1 << i)) {
+			nds_voices[i] = nds_started[i];
+			if(nds_voices[i].advance)
+				nds_active |= 1 << i;
+		}
+	nds_pending = 0;
+	memset(nds_left, 0, frames * 4);
+	memset(nds_right, 0, frames * 4);
+	for(i = 0; i < VOICES; i++)
+		if((nds_active & (1 << i)) && !nds_apu_render(&nds_voices[i], nds_left, nds_right, frames))
+			nds_active &= ~(1 << i);
+	for(i = 0; i < frames; i++) {
+		sample[i * 2] = clamp16(nds_left[i]);
+		sample[i * 2 + 1] = clamp16(nds_right[i]);
+	}
+}
+
+static Synth synths[] = {
+	{"generic", generic_deo, generic_mix},
+	{"nds", nds_deo, nds_mix}};
+
+#define SYNTHS (int)(sizeof(synths) / sizeof(*synths))
+
+/* streams */
+
+static AudioWrite *stream;
+static int stream_length, stream_size, stream_frames;
+
+static void
+emit(Uint8 port, Uint8 value)
+{
+	if(stream_length == stream_size) {
+		stream_size = stream_size ? stream_size * 2 : 4096;
+		stream = realloc(stream, stream_size * sizeof(*stream));
+	}
+	stream[stream_length].port = port;
+	stream[stream_length++].value = value;
+	if(!port)
+		stream_frames++;
+}
+
+static void
+emit2(Uint8 port, Uint16 value)
+{
+	emit(port, value >> 8);
+	emit(port + 1, value);
+}
+
+/* Starts a note on voice; cycles picks single cycle waveforms, otherwise samples longer than 0x100 bytes. */
+static void
+emit_note(int voice, int cycles, int repeat, Uint16 adsr)
+{
+	Uint8 port = 0x30 + voice * 0x10;
+	Uint16 len = cycles ? 2 + test_rand() % 0xff : 0x101 + test_rand() % 0x2000;
+	emit2(port + 0x8, adsr);
+	emit2(port + 0xa, len);
+	emit2(port + 0xc, test_rand() % (0x10000 - len));
+	emit(port + 0x5, test_rand());
+	emit(port + 0xe, test_rand());
+	emit(port + 0xf, (repeat ? 0 : 0x80) | (24 + test_rand() % 72));
+}
+
+/* Sampled notes at random on random voices, some frames with none, some with several on the same voice. */
+static void
+random_stream(int frames)
+{
+	int i, k, n;
+	stream_length = stream_frames = 0;
+	for(i = 0; i < frames; i++) {
+		for(k = 0, n = test_rand() % 4 ? 0 : 1 + test_rand() % 3; k < n; k++)
+			emit_note(test_rand() % VOICES, 0, test_rand() % 2, test_rand() % 2 ? test_rand() : 0);
+		emit(0x00, 0);
+	}
+}
+
+static int
+load_stream(char *path)
+{
+	FILE *f = fopen(path, "rb");
+	int c;
+	if(!f)
+		return 0;
+	stream_length = stream_frames = 0;
+	while((c = fgetc(f)) != EOF) {
+		int value = fgetc(f);
+		if(value == EOF)
+			break;
+		emit(c, value);
+	}
+	fclose(f);
+	if(stream_length && stream[stream_length - 1].port)
+		emit(0x00, 0);
+	return 1;
+}
+
+/* replay and compare */
+
+/* Stops every voice of both with a note out of range, which neither plays. */
+static void
+reset(void)
+{
+	int i, k;
+	Sint16 buffer[FRAME * 2];
+	for(k = 0; k < SYNTHS; k++) {
+		memset(synths[k].dev, 0, sizeof(synths[k].dev));
+		for(i = 0; i < VOICES; i++) {
+			synths[k].dev[i][0xf] = 0x7f;
+			synths[k].deo(i, synths[k].dev[i], 0xf);
+		}
+		synths[k].mix(buffer, FRAME);
+	}
+}
+
+static void
+replay(void)
+{
+	int i, k;
+	for(k = 0; k < SYNTHS; k++) {
+		Synth *s = &synths[k];
+		Sint16 *out = s->out = realloc(s->out, stream_frames * FRAME * 4);
+		double start = test_time();
+		for(i = 0; i < stream_length; i++) {
+			Uint8 port = stream[i].port, voice = (port >> 4) - 3;
+			if(!port) {
+				s->mix(out, FRAME);
+				out += FRAME * 2;
+			} else if(voice < VOICES) {
+				s->dev[voice][port & 0xf] = stream[i].value;
+				s->deo(voice, s->dev[voice], port & 0xf);
+			}
+		}
+		s->time += test_time() - start;
+	}
+}
+
+/* Compares the outputs of the last replay; returns the number of samples which differ. */
+static long
+compare(int print)
+{
+	long i, n = stream_frames * FRAME * 2, diffs = 0, first = -1;
+	double sum = 0, signal = 0;
+	int peak = 0;
+	for(i = 0; i < n; i++) {
+		int a = synths[0].out[i], b = synths[1].out[i], d = a > b ? a - b : b - a;
+		if(d) {
+			if(first < 0)
+				first = i;
+			diffs++;
+		}
+		if(d > peak)
+			peak = d;
+		sum += (double)d * d;
+		signal += (double)a * a;
+	}
+	if(print) {
+		printf("%ld frames, %ld samples: %ld differ, peak %d, rms %.1f against %.1f", (long)stream_frames, n, diffs, peak,
+			n ? sqrt(sum / n) : 0, n ? sqrt(signal / n) : 0);
+		if(first >= 0)
+			printf(", first at frame %ld sample %ld", first / 2 / FRAME, first / 2 % FRAME);
+		printf("\n");
+	}
+	return diffs;
+}
+
+/* bench */
+
+/* Times mixing voices repeating notes without an envelope, which never end. */
+static void
+bench_voices(int voices, int cycles)
+{
+	int i, k;
+	long blocks;
+	Sint16 buffer[FRAME * 2];
+	reset();
+	stream_length = stream_frames = 0;
+	for(i = 0; i < voices; i++)
+		emit_note(i, cycles, 1, 0x0000);
+	emit(0x00, 0);
+	replay();
+	for(k = 0; k < SYNTHS; k++) {
+		Synth *s = &synths[k];
+		double start, elapsed;
+		start = test_time(), blocks = 0;
+		do {
+			for(i = 0; i < 100; i++)
+				s->mix(buffer, FRAME);
+			blocks += i;
+		} while((elapsed = test_time() - start) < 0.2);
+		printf("%-8s %d voice%s %-7s %7.2f Mframes/s, %6.0fx realtime\n", s->name, voices, voices > 1 ? "s" : " ",
+			cycles ? "cycles" : "samples", blocks * FRAME / elapsed / 1e6, blocks * FRAME / elapsed / RATE);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, cycles;
+	char *path = NULL;
+	if(!test_init(argc, argv))
+		return 0;
+	for(i = 1; i + 1 < argc; i++)
+		if(!strcmp(argv[i], "--stream"))
+			path = argv[i + 1];
+	for(i = 0; i < 0x10000; i++)
+		ram[i] = test_rand();
+	u.ram.dat = ram;
+	audio_set_rate(RATE);
+	nds_apu_set_rate(RATE);
+	if(path) {
+		if(!load_stream(path)) {
+			fprintf(stderr, "cannot read %s\n", path);
+			return 1;
+		}
+		replay();
+		compare(1);
+		return 0;
+	}
+	if(test_bench) {
+		for(cycles = 0; cycles < 2; cycles++)
+			for(i = 1; i <= VOICES; i++)
+				bench_voices(i, cycles);
+		return 0;
+	}
+	for(i = 0; i < 20; i++) {
+		long diffs;
+		reset();
+		random_stream(600);
+		replay();
+		diffs = compare(0);
+		CHECK(!diffs, "stream %d of sampled notes: %ld samples differ", i, diffs);
+	}
+	return test_exit("audio_diff");
+}
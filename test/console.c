@@ -0,0 +1,140 @@
+#include <unistd.h>
+#include <sys/stat.h>
+#include "devices/system.c"
+#include "test.h"
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Tests of the console output buffering in system.c, with stdout sent to a
+file. --bench prints the bytes per second console_deo writes to /dev/null
+and into a pipe, against writing and flushing every byte as it used to.
+*/
+
+#define LINE "0123 LIT2 0100 ;on-reset JSR2 ( listing )\n"
+
+Uxn u;
+static int saved_stdout = -1;
+
+/* Points stdout at fd, or back at the terminal for -1. */
+static void
+redirect(int fd)
+{
+	fflush(stdout);
+	if(saved_stdout < 0)
+		saved_stdout = dup(1);
+	dup2(fd < 0 ? saved_stdout : fd, 1);
+}
+
+static long
+written(FILE *f)
+{
+	struct stat st;
+	fstat(fileno(f), &st);
+	return st.st_size;
+}
+
+static void
+put(Uint8 port, char *s)
+{
+	Uint8 d[0x10];
+	for(; *s; s++) {
+		d[port] = *s;
+		console_deo(d, port);
+	}
+}
+
+static void
+test_buffering(void)
+{
+	FILE *f = tmpfile();
+	char line[301], got[1024];
+	long n;
+	memset(line, 'x', 300);
+	line[300] = 0;
+	redirect(fileno(f));
+	put(0x8, "hello");
+	CHECK(written(f) == 0, "%ld bytes written before the newline", written(f));
+	put(0x8, " world\n");
+	CHECK(written(f) == 12, "%ld bytes written after the newline, not 12", written(f));
+	put(0x8, "ab");
+	put(0x9, "error\n");
+	CHECK(written(f) == 18, "port 0x9 line not written on its own: %ld bytes", written(f));
+	put(0x8, line);
+	CHECK(written(f) == 18 + CONSOLE_BUFFER, "full buffer not written: %ld bytes", written(f));
+	console_flush();
+	redirect(-1);
+	rewind(f);
+	n = fread(got, 1, sizeof(got) - 1, f);
+	got[n] = 0;
+	CHECK(n == 320 && !strncmp(got, "hello world\nerror\nab", 20) && !strncmp(got + 20, line, 300),
+		"wrote %ld bytes: %.40s", n, got);
+	fclose(f);
+}
+
+/* console_deo before it buffered */
+static void
+console_deo_unbuffered(Uint8 *d, Uint8 port)
+{
+	fputc(d[port], stdout);
+	fflush(stdout);
+}
+
+static double
+bench_output(void (*deo)(Uint8 *d, Uint8 port), long bytes, int fd)
+{
+	Uint8 d[0x10];
+	long i;
+	double start, elapsed;
+	char *s = LINE;
+	redirect(fd);
+	start = test_time();
+	for(i = 0; i < bytes; i++) {
+		d[0x8] = s[i % (sizeof(LINE) - 1)];
+		deo(d, 0x8);
+	}
+	console_flush();
+	elapsed = test_time() - start;
+	redirect(-1);
+	return bytes / elapsed / 1e6;
+}
+
+static void
+bench_console(void)
+{
+	FILE *null = fopen("/dev/null", "w"), *pipe = popen("cat > /dev/null", "w");
+	long bytes = (sizeof(LINE) - 1) * 400000;
+	if(!null || !pipe) {
+		fprintf(stderr, "cannot open /dev/null or a pipe\n");
+		return;
+	}
+	printf("%-12s %12s %12s\n", "", "per byte", "buffered");
+	printf("%-12s %7.1f MB/s %7.1f MB/s\n", "/dev/null", bench_output(console_deo_unbuffered, bytes / 4, fileno(null)),
+		bench_output(console_deo, bytes, fileno(null)));
+	printf("%-12s %7.1f MB/s %7.1f MB/s\n", "pipe", bench_output(console_deo_unbuffered, bytes / 4, fileno(pipe)),
+		bench_output(console_deo, bytes, fileno(pipe)));
+	fclose(null);
+	pclose(pipe);
+}
+
+int
+main(int argc, char **argv)
+{
+	if(!test_init(argc, argv))
+		return 0;
+	if(test_bench) {
+		bench_console();
+		return 0;
+	}
+	test_buffering();
+	return test_exit("console");
+}
@@ -0,0 +1,318 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include "util.c"
+#include "3ds/ctr_screen.c"
+#include "test.h"
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+3DS renderer: the paired-pixel layer conversion, against a per-pixel lookup,
+and the split redraw run on a second thread as source/3ds/emulator.c does with
+ENABLE_CTR_RENDER_THREAD, with frame times against the synchronous redraw.
+*/
+
+#define WIDTH 320
+#define HEIGHT 240
+#define UNTOUCHED 0xdeadbeef
+
+#include "sprite.h"
+
+Uxn u;
+static Uint8 ram[0x10000], dev[0x10];
+
+static void
+random_palette(void)
+{
+	Uint8 p[6];
+	int i;
+	for(i = 0; i < 6; i++)
+		p[i] = test_rand();
+	ctr_screen_palette(&uxn_ctr_screen, p);
+}
+
+/* What ctr_screen_convert_layer replaced: one lookup per pixel over whole rows. */
+static void
+convert_per_pixel(UxnCtrScreen *p, Layer *layer, int y1, int y2)
+{
+	Uint32 x, y, *dest = layer->gpuPixels + y1 * p->pitch;
+	Uint8 *src = layer->pixels + y1 * p->width;
+	for(y = y1; y < y2; y++, dest += p->pitch)
+		for(x = 0; x < p->width; x++)
+			dest[x] = layer->palette[*(src++)];
+}
+
+static void
+test_convert_layer(Layer *layer)
+{
+	UxnCtrScreen *p = &uxn_ctr_screen;
+	int i, x, y, round, x1, x2, y1, y2, bad = 0;
+	for(round = 0; round < 200; round++) {
+		random_palette();
+		for(i = 0; i < WIDTH * HEIGHT; i++)
+			layer->pixels[i] = test_rand() & 3;
+		for(i = 0; i < p->pitch * HEIGHT; i++)
+			layer->gpuPixels[i] = UNTOUCHED;
+		x1 = test_rand() % WIDTH, x2 = x1 + test_rand() % (WIDTH - x1 + 1);
+		y1 = test_rand() % HEIGHT, y2 = y1 + test_rand() % (HEIGHT - y1 + 1);
+		ctr_screen_convert_layer(p, layer, layer->pixels, layer->palette2, x1, y1, x2, y2);
+		/* pairs are converted whole, so an odd edge widens the span by one */
+		for(y = 0; y < HEIGHT; y++)
+			for(x = 0; x < p->pitch; x++) {
+				int inside = y >= y1 && y < y2 && x >= (x1 & ~1) && x < ((x2 + 1) & ~1);
+				Uint32 want = inside ? layer->palette[layer->pixels[x + y * WIDTH]] : UNTOUCHED;
+				if(layer->gpuPixels[x + y * p->pitch] != want && !bad++)
+					CHECK(0, "%s: span %d,%d-%d,%d pixel %d,%d is %08x, not %08x", layer == &p->fg ? "fg" : "bg",
+						x1, y1, x2, y2, x, y, layer->gpuPixels[x + y * p->pitch], want);
+			}
+	}
+}
+
+/* A sprite strip, or a pixel run or fill, at random. */
+static void
+random_deo(void)
+{
+	Uint16 x, y;
+	if(test_rand() & 1) {
+		x = test_rand() % (WIDTH + 16) - 8, y = test_rand() % (HEIGHT + 16) - 8;
+		POKE2(dev + 0x8, x);
+		POKE2(dev + 0xa, y);
+		dev[0x6] = test_rand();
+		x = test_rand();
+		POKE2(dev + 0xc, x);
+		dev[0xf] = test_rand();
+		ctr_screen_deo(dev, 0xf);
+	} else {
+		x = test_rand() % WIDTH, y = test_rand() % HEIGHT;
+		POKE2(dev + 0x8, x);
+		POKE2(dev + 0xa, y);
+		dev[0x6] = test_rand() % 4;
+		dev[0xe] = test_rand() & 0xf3;
+		ctr_screen_deo(dev, 0xe);
+	}
+}
+
+/* After drawing, the converted layers must match a full per-pixel conversion. */
+static void
+test_redraw(void)
+{
+	UxnCtrScreen *p = &uxn_ctr_screen;
+	int i, round;
+	Uint32 *want = malloc(p->pitch * HEIGHT * 4);
+	for(round = 0; round < 100; round++) {
+		if(round % 10 == 9)
+			random_palette();
+		random_deo();
+		ctr_screen_redraw(p);
+		for(i = 0; i < 2; i++) {
+			Layer *layer = i ? &p->fg : &p->bg;
+			memcpy(want, layer->gpuPixels, p->pitch * HEIGHT * 4);
+			convert_per_pixel(p, layer, 0, HEIGHT);
+			CHECK(!memcmp(want, layer->gpuPixels, p->pitch * HEIGHT * 4), "round %d: %s differs after redraw", round, i ? "fg" : "bg");
+		}
+	}
+	free(want);
+}
+
+static void
+sprite_draw(SpriteCase *c, Uint8 *sprite)
+{
+	screen_blit(&uxn_ctr_screen, uxn_ctr_screen.bg.pixels, c->x, c->y, 0, 0, ram, sprite - ram, 0, 0, c->color, c->flipx, c->flipy, c->twobpp);
+}
+
+static void
+sprite_read(Uint8 *layer)
+{
+	memcpy(layer, uxn_ctr_screen.bg.pixels, WIDTH * HEIGHT);
+}
+
+/* The render thread of source/3ds/emulator.c, on pthreads. */
+static sem_t render_start, render_done;
+static volatile int render_quit;
+
+static void *
+render_thread(void *arg)
+{
+	while(1) {
+		sem_wait(&render_start);
+		if(render_quit)
+			break;
+		ctr_screen_convert(&uxn_ctr_screen);
+		sem_post(&render_done);
+	}
+	return NULL;
+}
+
+static int
+render_thread_init(pthread_t *thread)
+{
+	sem_init(&render_start, 0, 0);
+	sem_init(&render_done, 0, 1);
+	render_quit = 0;
+	return !pthread_create(thread, NULL, render_thread, NULL);
+}
+
+static void
+render_thread_exit(pthread_t thread)
+{
+	sem_wait(&render_done);
+	render_quit = 1;
+	sem_post(&render_start);
+	pthread_join(thread, NULL);
+	sem_destroy(&render_start);
+	sem_destroy(&render_done);
+}
+
+/* As redraw() in source/3ds/emulator.c: upload the last frame, hand over this one. */
+static void
+render_frame(void)
+{
+	sem_wait(&render_done);
+	ctr_screen_present(&uxn_ctr_screen);
+	ctr_screen_snapshot(&uxn_ctr_screen);
+	sem_post(&render_start);
+}
+
+/* Whether a layer shows the given index pixels. */
+static int
+layer_shows(Layer *layer, Uint8 *pixels)
+{
+	UxnCtrScreen *p = &uxn_ctr_screen;
+	int x, y;
+	for(y = 0; y < HEIGHT; y++)
+		for(x = 0; x < WIDTH; x++)
+			if(layer->gpuPixels[x + y * p->pitch] != layer->palette[pixels[x + y * WIDTH]])
+				return 0;
+	return 1;
+}
+
+/* Each frame converted on the thread shows the layers as they were when it was handed over. */
+static void
+test_render_thread(void)
+{
+	UxnCtrScreen *p = &uxn_ctr_screen;
+	Uint8 *shown[2];
+	pthread_t thread;
+	int i, frame;
+	ctr_screen_redraw(p);
+	if(!render_thread_init(&thread)) {
+		CHECK(0, "cannot start the render thread");
+		return;
+	}
+	for(i = 0; i < 2; i++)
+		shown[i] = malloc(WIDTH * HEIGHT);
+	for(frame = 0; frame < 100; frame++) {
+		for(i = test_rand() % 8; i >= 0; i--)
+			random_deo();
+		render_frame();
+		memcpy(shown[0], p->bg.pixels, WIDTH * HEIGHT);
+		memcpy(shown[1], p->fg.pixels, WIDTH * HEIGHT);
+		/* the VM runs the next frame meanwhile */
+		for(i = test_rand() % 8; i >= 0; i--)
+			random_deo();
+		sem_wait(&render_done);
+		CHECK(layer_shows(&p->bg, shown[0]) && layer_shows(&p->fg, shown[1]), "frame %d: converted layers differ", frame);
+		sem_post(&render_done);
+	}
+	render_thread_exit(thread);
+	for(i = 0; i < 2; i++)
+		free(shown[i]);
+}
+
+/* Frame time with a given number of sprites drawn per frame, redrawn synchronously and on the thread. */
+static void
+bench_frames(int sprites)
+{
+	UxnCtrScreen *p = &uxn_ctr_screen;
+	pthread_t thread;
+	int i, k, frames;
+	double start, elapsed[2];
+	for(k = 0; k < 2; k++) {
+		if(k && !render_thread_init(&thread))
+			return;
+		frames = 0;
+		start = test_time();
+		do {
+			for(i = 0; i < sprites; i++) {
+				Uint16 x = test_rand() % WIDTH, y = test_rand() % HEIGHT;
+				POKE2(dev + 0x8, x);
+				POKE2(dev + 0xa, y);
+				dev[0x6] = 0;
+				dev[0xf] = 0x81 | (test_rand() & 0x40);
+				ctr_screen_deo(dev, 0xf);
+			}
+			if(k)
+				render_frame();
+			else
+				ctr_screen_redraw(p);
+			frames++;
+		} while((elapsed[k] = test_time() - start) < 0.5);
+		if(k)
+			render_thread_exit(thread);
+		elapsed[k] = elapsed[k] * 1e6 / frames;
+	}
+	printf("frame %5d sprites: synchronous %7.1f us, render thread %7.1f us\n", sprites, elapsed[0], elapsed[1]);
+}
+
+static void
+bench_convert(char *name, int x1, int x2)
+{
+	UxnCtrScreen *p = &uxn_ctr_screen;
+	Layer *layer = &p->bg;
+	int i, frames;
+	double start, elapsed[2];
+	for(i = 0; i < WIDTH * HEIGHT; i++)
+		layer->pixels[i] = test_rand() & 3;
+	for(i = 0; i < 2; i++) {
+		frames = 0;
+		start = test_time();
+		do {
+			if(i)
+				ctr_screen_convert_layer(p, layer, layer->pixels, layer->palette2, x1, 0, x2, HEIGHT);
+			else
+				convert_per_pixel(p, layer, 0, HEIGHT);
+			frames++;
+		} while((elapsed[i] = test_time() - start) < 0.25);
+		elapsed[i] = elapsed[i] * 1e6 / frames;
+	}
+	printf("convert %-10s %3d columns: per pixel %7.1f us, paired %7.1f us\n", name, x2 - x1, elapsed[0], elapsed[1]);
+}
+
+int
+main(int argc, char **argv)
+{
+	int i;
+	if(!test_init(argc, argv))
+		return 0;
+	for(i = 0; i < 0x10000; i++)
+		ram[i] = test_rand();
+	u.ram.dat = ram;
+	ctr_screen_init(&uxn_ctr_screen, WIDTH, HEIGHT);
+	random_palette();
+	if(test_bench) {
+		bench_convert("full", 0, WIDTH);
+		bench_convert("sprite", 152, 160);
+		bench_convert("odd", 151, 161);
+		bench_frames(16);
+		bench_frames(256);
+		bench_frames(4096);
+		bench_sprite_cases("3ds", sprite_draw, ram);
+		return 0;
+	}
+	test_convert_layer(&uxn_ctr_screen.bg);
+	test_convert_layer(&uxn_ctr_screen.fg);
+	test_redraw();
+	test_render_thread();
+	test_sprite_cases("3ds", sprite_draw, sprite_read, ram);
+	ctr_screen_free(&uxn_ctr_screen);
+	return test_exit("ctr_screen");
+}
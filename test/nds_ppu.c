@@ -0,0 +1,268 @@
+#include "../arm9/source/nds_ppu.c"
+#include "test.h"
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+NDS renderer: the drawing kernels against a per-pixel model of the screen
+device, the copy of dirty tiles to the displayed layers, sprite throughput
+by kind, and with --ppm <file> a dump of the displayed layers after random
+drawing. Built with DEBUG_PROFILE for the copy statistics.
+*/
+
+#define WIDTH PPU_PIXELS_WIDTH
+#define HEIGHT PPU_PIXELS_HEIGHT
+
+#include "sprite.h"
+
+Uxn u;
+static NdsPpu ppu;
+static Uint8 ram[0x10000];
+static Uint8 model[2][HEIGHT][WIDTH]; /* bg, fg */
+
+static int
+vram_init(void)
+{
+	if(!nds_vram_map()) {
+		fprintf(stderr, "cannot map VRAM at %08x\n", NDS_VRAM_A);
+		return 0;
+	}
+	return nds_initppu(&ppu);
+}
+
+static Uint8
+layer_pixel(Uint32 *layer, int x, int y)
+{
+	return (layer[(y & 7) + ((x >> 3) + (y >> 3) * PPU_TILES_WIDTH) * 8] >> ((x & 7) << 2)) & 0xf;
+}
+
+static Uint16
+random_coord(int limit)
+{
+	switch(test_rand() % 8) {
+	case 0: return -(int)(test_rand() % 12);
+	case 1: return limit - test_rand() % 12;
+	case 2: return test_rand() % (limit / 8) * 8;
+	default: return test_rand() % limit;
+	}
+}
+
+/* Draws the same random operation into the PPU and into the model. */
+static void
+random_draw(void)
+{
+	int l = test_rand() & 1, k;
+	Uint32 *layer = l ? ppu.fg : ppu.bg;
+	Uint16 x = random_coord(WIDTH), y = random_coord(HEIGHT);
+	Uint8 color = test_rand() & 0xf;
+	switch(test_rand() % 6) {
+	case 0: {
+		Uint16 x2 = x + test_rand() % 80, y2 = y + test_rand() % 80, i, j;
+		if(x >= WIDTH || y >= HEIGHT)
+			break;
+		nds_ppu_fill(&ppu, layer, x, y, x2, y2, color & 3);
+		for(j = y; j < y2 && j < HEIGHT; j++)
+			for(i = x; i < x2 && i < WIDTH; i++)
+				model[l][j][i] = color & 3;
+		break;
+	}
+	case 1:
+		nds_ppu_pixel(&ppu, layer, x, y, color & 3);
+		if(x < WIDTH && y < HEIGHT)
+			model[l][y][x] = color & 3;
+		break;
+	default: {
+		Uint8 twobpp = test_rand() & 1, flipx = test_rand() & 1, flipy = test_rand() & 1, count = test_rand() % 4;
+		Uint16 addr = test_rand() % (0x10000 - 0x100), step = (test_rand() & 1) << (3 + twobpp);
+		Uint16 dx = 0, dy = 0;
+		if(test_rand() & 1)
+			dx = flipy ? -8 : 8;
+		else
+			dy = flipx ? -8 : 8;
+		nds_ppu_sprite(&ppu, layer, x, y, dx, dy, ram + addr, step, count, color, flipx, flipy, twobpp);
+		for(k = 0; k <= count; k++)
+			model_sprite(&model[l][0][0], WIDTH, HEIGHT, x + dx * k, y + dy * k, ram + addr + step * k, color, flipx, flipy, twobpp);
+	}
+	}
+}
+
+static void
+test_draw(void)
+{
+	int i, l, x, y, round, bad = 0;
+	for(round = 0; round < 50; round++) {
+		for(i = 0; i < 40; i++)
+			random_draw();
+		for(l = 0; l < 2; l++)
+			for(y = 0; y < HEIGHT; y++)
+				for(x = 0; x < WIDTH; x++) {
+					Uint8 got = layer_pixel(l ? ppu.fg : ppu.bg, x, y);
+					if(got != model[l][y][x] && !bad++)
+						CHECK(0, "round %d: %s pixel %d,%d is %d, not %d", round, l ? "fg" : "bg", x, y, got, model[l][y][x]);
+				}
+	}
+	/* what is displayed after a copy */
+	nds_copyppu(&ppu);
+	for(l = 0; l < 2; l++) {
+		Uint32 *back = l ? ppu.fg : ppu.bg;
+		Uint32 *front = (Uint32 *)((uintptr_t)back & 0xFFFEFFFF);
+		CHECK(!memcmp(front, back, PPU_TILES_WIDTH * PPU_TILES_HEIGHT * 32), "%s: front buffer differs after copy", l ? "fg" : "bg");
+	}
+}
+
+/* Dirty rows of tiles: empty, whole, runs touching either end, and random. */
+static Uint32
+random_dirty(void)
+{
+	switch(test_rand() % 8) {
+	case 0: return 0;
+	case 1: return 0xffffffff;
+	case 2: return 0x80000000;
+	case 3: return 0xfffffffe;
+	case 4: return 0x7fffffff;
+	case 5: return 1u << (test_rand() % 32);
+	default: return test_rand() ^ test_rand() << 16;
+	}
+}
+
+/*
+nds_copyppu against random back and front buffers: dirty tiles reach the
+front buffer, clean ones stay as they were, and the leading tiles of a dirty
+run which already match the front buffer are counted as skipped.
+*/
+static void
+test_copy(void)
+{
+	static Uint32 old[2][PPU_TILES_WIDTH * PPU_TILES_HEIGHT * 8];
+	Uint32 dirty[PPU_TILES_HEIGHT];
+	int round, l, i, tx, ty;
+	for(round = 0; round < 200; round++) {
+		Uint32 skipped = 0, tiles = 0;
+		for(l = 0; l < 2; l++) {
+			Uint32 *back = l ? ppu.fg : ppu.bg;
+			Uint32 *front = (Uint32 *)((uintptr_t)back & 0xFFFEFFFF);
+			for(i = 0; i < PPU_TILES_WIDTH * PPU_TILES_HEIGHT * 8; i++)
+				back[i] = test_rand() ^ test_rand() << 16;
+			for(i = 0; i < PPU_TILES_WIDTH * PPU_TILES_HEIGHT; i++) {
+				/* a third of the tiles already shown, some differing in their last word only */
+				if(test_rand() % 3)
+					memcpy(front + i * 8, back + i * 8, 32);
+				else if(test_rand() & 1)
+					memcpy(front + i * 8, back + i * 8, 28), front[i * 8 + 7] = ~back[i * 8 + 7];
+				else
+					for(tx = 0; tx < 8; tx++)
+						front[i * 8 + tx] = test_rand() ^ test_rand() << 16;
+			}
+			memcpy(old[l], front, sizeof(old[l]));
+		}
+		for(ty = 0; ty < PPU_TILES_HEIGHT; ty++)
+			tile_dirty[ty] = dirty[ty] = random_dirty();
+		/* the tiles to skip: those matching the front buffer at the start of each run */
+		for(l = 0; l < 2; l++)
+			for(ty = 0; ty < PPU_TILES_HEIGHT; ty++) {
+				int leading = 1;
+				for(tx = 0; tx < PPU_TILES_WIDTH; tx++) {
+					int ofs = (ty << 8) | (tx << 3);
+					if(!(dirty[ty] >> tx & 1)) {
+						leading = 1;
+						continue;
+					}
+					tiles++;
+					if(leading && !memcmp((l ? ppu.fg : ppu.bg) + ofs, old[l] + ofs, 32))
+						skipped++;
+					else
+						leading = 0;
+				}
+			}
+		nds_ppu_stats.tiles_copied = nds_ppu_stats.tiles_skipped = 0;
+		nds_copyppu(&ppu);
+		for(l = 0; l < 2; l++) {
+			Uint32 *back = l ? ppu.fg : ppu.bg;
+			Uint32 *front = (Uint32 *)((uintptr_t)back & 0xFFFEFFFF);
+			for(ty = 0; ty < PPU_TILES_HEIGHT; ty++)
+				for(tx = 0; tx < PPU_TILES_WIDTH; tx++) {
+					int ofs = (ty << 8) | (tx << 3);
+					Uint32 *want = (dirty[ty] >> tx & 1) ? back + ofs : old[l] + ofs;
+					CHECK(!memcmp(front + ofs, want, 32), "round %d: %s tile %d,%d (%s) not as expected", round,
+						l ? "fg" : "bg", tx, ty, (dirty[ty] >> tx & 1) ? "dirty" : "clean");
+				}
+		}
+		for(ty = 0; ty < PPU_TILES_HEIGHT; ty++)
+			CHECK(!tile_dirty[ty], "round %d: row %d still dirty", round, ty);
+		CHECK(nds_ppu_stats.tiles_copied + nds_ppu_stats.tiles_skipped == tiles, "round %d: %u copied and %u skipped of %u",
+			round, nds_ppu_stats.tiles_copied, nds_ppu_stats.tiles_skipped, tiles);
+		CHECK(nds_ppu_stats.tiles_skipped == skipped, "round %d: %u skipped, not %u", round, nds_ppu_stats.tiles_skipped, skipped);
+	}
+}
+
+/* Both displayed layers, fg over bg, in the colors of BG_PALETTE. */
+static int
+dump_ppm(char *path)
+{
+	FILE *f = fopen(path, "wb");
+	Uint32 *bg = (Uint32 *)((uintptr_t)ppu.bg & 0xFFFEFFFF), *fg = (Uint32 *)((uintptr_t)ppu.fg & 0xFFFEFFFF);
+	int x, y;
+	if(!f)
+		return 0;
+	fprintf(f, "P6\n%d %d\n31\n", WIDTH, HEIGHT);
+	for(y = 0; y < HEIGHT; y++)
+		for(x = 0; x < WIDTH; x++) {
+			Uint8 i = layer_pixel(fg, x, y);
+			Uint16 c = BG_PALETTE[i ? i : layer_pixel(bg, x, y)];
+			fputc(c & 0x1f, f);
+			fputc(c >> 5 & 0x1f, f);
+			fputc(c >> 10 & 0x1f, f);
+		}
+	return !fclose(f);
+}
+
+static void
+sprite_draw(SpriteCase *c, Uint8 *sprite)
+{
+	nds_ppu_sprite(&ppu, ppu.bg, c->x, c->y, 0, 0, sprite, 0, 0, c->color, c->flipx, c->flipy, c->twobpp);
+}
+
+static void
+sprite_read(Uint8 *layer)
+{
+	int x, y;
+	for(y = 0; y < HEIGHT; y++)
+		for(x = 0; x < WIDTH; x++)
+			layer[x + y * WIDTH] = layer_pixel(ppu.bg, x, y);
+}
+
+int
+main(int argc, char **argv)
+{
+	int i;
+	if(!test_init(argc, argv))
+		return 0;
+	if(!vram_init())
+		return 1;
+	for(i = 0; i < 0x10000; i++)
+		ram[i] = test_rand();
+	{
+		Uint8 colors[6] = {0x0f, 0x7c, 0x0f, 0xd6, 0x0f, 0x98};
+		nds_putcolors(&ppu, colors);
+	}
+	if(test_bench) {
+		bench_sprite_cases("nds_ppu", sprite_draw, ram);
+		return 0;
+	}
+	test_draw();
+	test_sprite_cases("nds_ppu", sprite_draw, sprite_read, ram);
+	for(i = 1; i + 1 < argc; i++)
+		if(!strcmp(argv[i], "--ppm"))
+			CHECK(dump_ppm(argv[i + 1]), "cannot write %s", argv[i + 1]);
+	test_copy();
+	return test_exit("nds_ppu");
+}
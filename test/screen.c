@@ -0,0 +1,286 @@
+#include "devices/screen.c"
+#include "test.h"
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Generic renderer: redraw kernels against a per-pixel reference. Built once per
+instruction set, see Makefile.host. The benchmark reports the layer memory
+and the fill, sprite and redraw throughput at several screen sizes.
+*/
+
+#if defined(__AVX2__)
+#define SCREEN_KERNEL "avx2"
+#elif defined(__SSSE3__)
+#define SCREEN_KERNEL "ssse3"
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SCREEN_KERNEL "neon"
+#else
+#define SCREEN_KERNEL "scalar"
+#endif
+
+/* for the sprite cases */
+#define WIDTH 256
+#define HEIGHT 192
+
+#include "sprite.h"
+
+Uxn u;
+static Uint8 ram[0x10000], dev[0x10];
+
+static void
+random_palette(void)
+{
+	Uint8 p[6];
+	int i;
+	for(i = 0; i < 6; i++)
+		p[i] = test_rand();
+	screen_palette(p);
+}
+
+static Uint16
+random_coord(int limit)
+{
+	switch(test_rand() % 8) {
+	case 0: return -(int)(test_rand() % 16);
+	case 1: return limit - test_rand() % 16;
+	default: return test_rand() % (limit + 8);
+	}
+}
+
+/* Fills, pixel runs and sprites at random, including ones crossing the edges. */
+static void
+random_draw(int count)
+{
+	int i, k, n;
+	Uint16 v;
+	for(i = 0; i < count; i++) {
+		v = random_coord(uxn_screen.width);
+		POKE2(dev + 0x8, v);
+		v = random_coord(uxn_screen.height);
+		POKE2(dev + 0xa, v);
+		switch(test_rand() % 8) {
+		case 0:
+			dev[0xe] = 0x80 | (test_rand() & 0x73);
+			screen_deo(ram, dev, 0xe);
+			break;
+		case 1:
+		case 2:
+			dev[0x6] = test_rand() % 4;
+			for(k = 0, n = 1 + test_rand() % 24; k < n; k++) {
+				dev[0xe] = test_rand() & 0x43;
+				screen_deo(ram, dev, 0xe);
+			}
+			break;
+		default:
+			dev[0x6] = test_rand();
+			v = test_rand();
+			POKE2(dev + 0xc, v);
+			dev[0xf] = test_rand();
+			screen_deo(ram, dev, 0xf);
+		}
+	}
+}
+
+static Uint32
+reference_pixel(int x, int y)
+{
+	Uint8 *tile = uxn_screen.tiles[y / TILE_SIZE][x / TILE_SIZE];
+	int i = tile ? (tile[(y % TILE_SIZE) * TILE_STRIDE + (x % TILE_SIZE) / 2] >> ((x & 1) << 2)) & 0xf : 0;
+	return uxn_screen.palette[(i >> 2) ? (i >> 2) : (i & 3)];
+}
+
+static void
+test_redraw_span(void)
+{
+	Uint8 row[TILE_STRIDE + 8], planes[4][16];
+	Uint32 palette[16], dst[TILE_SIZE + 1];
+	int i, x, n, round;
+	for(round = 0; round < 16; round++) {
+		for(i = 0; i < 16; i++) {
+			palette[i] = test_rand() ^ test_rand() << 16;
+			planes[0][i] = palette[i];
+			planes[1][i] = palette[i] >> 8;
+			planes[2][i] = palette[i] >> 16;
+			planes[3][i] = palette[i] >> 24;
+		}
+		for(i = 0; i < (int)sizeof(row); i++)
+			row[i] = test_rand();
+		for(x = 0; x < TILE_SIZE; x++)
+			for(n = 0; x + n <= TILE_SIZE; n++) {
+				dst[n] = 0xdeadbeef;
+				screen_redraw_span(dst, row, x, n, palette, planes);
+				for(i = 0; i < n; i++)
+					CHECK(dst[i] == palette[(row[(x + i) >> 1] >> (((x + i) & 1) << 2)) & 0xf],
+						"span x %d n %d: pixel %d is %08x", x, n, i, dst[i]);
+				CHECK(dst[n] == 0xdeadbeef, "span x %d n %d: wrote past the end", x, n);
+			}
+	}
+}
+
+static void
+test_redraw(int width, int height)
+{
+	int x, y, round, bad = 0;
+	screen_resize(width, height);
+	random_palette();
+	for(round = 0; round < 8; round++) {
+		random_draw(64);
+		if(round & 1)
+			random_palette();
+		if(round == 4) {
+			/* the dirty area only, then everything */
+			screen_redraw();
+			screen_change(0, 0, width, height);
+		}
+		CHECK(screen_redraw(), "%dx%d: nothing redrawn", width, height);
+		CHECK(!screen_redraw(), "%dx%d: redrawn twice", width, height);
+		for(y = 0; y < height; y++)
+			for(x = 0; x < width; x++)
+				if(uxn_screen.pixels[x + y * width] != reference_pixel(x, y) && !bad++)
+					CHECK(0, "%dx%d round %d: pixel %d,%d is %08x, not %08x", width, height, round, x, y,
+						uxn_screen.pixels[x + y * width], reference_pixel(x, y));
+	}
+}
+
+static void
+sprite_draw(SpriteCase *c, Uint8 *sprite)
+{
+	screen_blit(0, ram, sprite - ram, 0, c->x, c->y, 0, 0, 0, c->color, c->flipx, c->flipy, c->twobpp);
+}
+
+static void
+sprite_read(Uint8 *layer)
+{
+	int x, y;
+	for(y = 0; y < HEIGHT; y++)
+		for(x = 0; x < WIDTH; x++) {
+			Uint8 *tile = uxn_screen.tiles[y / TILE_SIZE][x / TILE_SIZE];
+			layer[x + y * WIDTH] = tile ? (tile[(y % TILE_SIZE) * TILE_STRIDE + (x % TILE_SIZE) / 2] >> ((x & 1) << 2)) & 3 : 0;
+		}
+}
+
+/* Bytes held by the layer tiles. */
+static long
+layer_bytes(void)
+{
+	int tx, ty;
+	long bytes = 0;
+	for(ty = 0; ty < SCREEN_TILES; ty++)
+		for(tx = 0; tx < SCREEN_TILES; tx++)
+			if(uxn_screen.tiles[ty][tx])
+				bytes += TILE_BYTES;
+	return bytes;
+}
+
+/* Layer memory, against one byte per pixel and layer, when empty and after drawing. */
+static void
+bench_footprint(int width, int height)
+{
+	long empty, drawn;
+	/* drop every tile */
+	screen_resize(8, 8);
+	if(uxn_screen.tiles[0][0])
+		screen_tile_release(&uxn_screen.tiles[0][0]);
+	screen_resize(width, height);
+	empty = layer_bytes();
+	random_draw(width * height / 256);
+	drawn = layer_bytes();
+	printf("memory %4dx%-4d layers %5ld KiB empty, %5ld KiB drawn, %5d KiB unpacked; pixels %5d KiB\n", width, height,
+		empty >> 10, drawn >> 10, width * height * 2 >> 10, width * height * 4 >> 10);
+}
+
+static void
+bench_fill(int width, int height)
+{
+	long fills = 0;
+	double start, elapsed;
+	screen_resize(width, height);
+	start = test_time();
+	do {
+		screen_fill((fills & 1) << 1, 0, 0, width, height, 1 + fills % 3);
+		fills++;
+	} while((elapsed = test_time() - start) < 0.25);
+	printf("fill   %4dx%-4d %9.1f us/layer %8.1f Mpixel/s\n", width, height,
+		elapsed * 1e6 / fills, (double)width * height * fills / elapsed / 1e6);
+}
+
+static void
+bench_sprites(int width, int height)
+{
+	long sprites = 0;
+	double start, elapsed;
+	screen_resize(width, height);
+	start = test_time();
+	do {
+		int i;
+		for(i = 0; i < 1000; i++)
+			screen_blit(i & 2, ram, i * 16, 0, test_rand() % width, test_rand() % height, 0, 0, 0, 1 + (i & 7), 0, 0, i & 1);
+		sprites += i;
+	} while((elapsed = test_time() - start) < 0.25);
+	printf("sprite %4dx%-4d %9.2f Msprites/s\n", width, height, sprites / elapsed / 1e6);
+}
+
+static void
+bench_redraw(int width, int height)
+{
+	int frames = 0;
+	double start, elapsed;
+	screen_resize(width, height);
+	random_palette();
+	random_draw(width * height / 64);
+	start = test_time();
+	do {
+		screen_change(0, 0, width, height);
+		screen_redraw();
+		frames++;
+	} while((elapsed = test_time() - start) < 0.5);
+	printf("redraw %4dx%-4d %9.1f us/frame %8.1f Mpixel/s (%s)\n", width, height,
+		elapsed * 1e6 / frames, (double)width * height * frames / elapsed / 1e6, SCREEN_KERNEL);
+}
+
+static void
+bench_size(int width, int height)
+{
+	bench_footprint(width, height);
+	bench_fill(width, height);
+	bench_sprites(width, height);
+	bench_redraw(width, height);
+}
+
+int
+main(int argc, char **argv)
+{
+	int i;
+	if(!test_init(argc, argv))
+		return 0;
+	for(i = 0; i < 0x10000; i++)
+		ram[i] = test_rand();
+	if(test_bench) {
+		bench_size(256, 192);
+		bench_size(320, 240);
+		bench_size(640, 480);
+		bench_size(1023, 1023);
+		screen_resize(WIDTH, HEIGHT);
+		bench_sprite_cases("generic", sprite_draw, ram);
+		return 0;
+	}
+	test_redraw_span();
+	test_redraw(8, 8);
+	test_redraw(101, 37);
+	test_redraw(256, 192);
+	test_redraw(320, 240);
+	test_redraw(1023, 1023);
+	screen_resize(WIDTH, HEIGHT);
+	test_sprite_cases("generic", sprite_draw, sprite_read, ram);
+	return test_exit("screen " SCREEN_KERNEL);
+}
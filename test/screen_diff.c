@@ -0,0 +1,331 @@
+#include <nds.h>
+#include "uxn.h"
+#include "devices/screen.h"
+#include "3ds/ctr_screen.h"
+#include "../arm9/source/nds_ppu.h"
+#include "test.h"
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Differential test of the three screen renderers: the generic screen.c, the
+NDS nds_ppu.c and the 3DS ctr_screen.c. The same stream of screen device
+writes, pairs of port and value as the VM's DEOs, is replayed into each of
+them; their layers are then read back as index images over the common
+256x192 area and compared with the generic renderer's, along with the
+device ports each one leaves behind.
+
+Streams are generated at random, or read with --stream <file>. Writes to the
+size ports are skipped: the NDS screen has a fixed size. --bench replays a
+long stream and prints the time each renderer took.
+*/
+
+#define WIDTH PPU_PIXELS_WIDTH
+#define HEIGHT PPU_PIXELS_HEIGHT
+
+typedef struct {
+	Uint8 port, value;
+} ScreenWrite;
+
+typedef struct {
+	char *name;
+	void (*deo)(Uint8 *d, Uint8 port);
+	void (*present)(void);
+	Uint8 (*pixel)(int fg, int x, int y);
+	Uint8 dev[0x10];
+	double draw_time, present_time;
+	long diffs[2], dev_diffs;
+} Renderer;
+
+Uxn u;
+static Uint8 ram[0x10000];
+static NdsPpu ppu;
+
+/* generic */
+
+static void generic_deo(Uint8 *d, Uint8 port) { screen_deo(ram, d, port); }
+static void generic_present(void) { screen_redraw(); }
+
+static Uint8
+generic_pixel(int fg, int x, int y)
+{
+	Uint8 *tile = uxn_screen.tiles[y / 64][x / 64];
+	int i = tile ? (tile[(y % 64) * 32 + (x % 64) / 2] >> ((x & 1) << 2)) & 0xf : 0;
+	return fg ? i >> 2 : i & 3;
+}
+
+/* 3DS */
+
+static void ctr_present(void) { ctr_screen_redraw(&uxn_ctr_screen); }
+
+static Uint8
+ctr_pixel(int fg, int x, int y)
+{
+	return (fg ? uxn_ctr_screen.fg.pixels : uxn_ctr_screen.bg.pixels)[x + y * uxn_ctr_screen.width];
+}
+
+/* NDS: the screen port decoding of arm9/source/emulator.c, without its pixel span coalescing */
+
+static void
+nds_deo(Uint8 *d, Uint8 port)
+{
+	if(port == 0xe) {
+		Uint8 ctrl = d[0xe], color = ctrl & 0x3;
+		Uint16 x = PEEK2(d + 0x8), y = PEEK2(d + 0xa);
+		Uint32 *layer = (ctrl & 0x40) ? ppu.fg : ppu.bg;
+		if(ctrl & 0x80) {
+			Uint16 x2 = PPU_PIXELS_WIDTH, y2 = PPU_PIXELS_HEIGHT;
+			if(ctrl & 0x10) x2 = x, x = 0;
+			if(ctrl & 0x20) y2 = y, y = 0;
+			nds_ppu_fill(&ppu, layer, x, y, x2, y2, color);
+		} else {
+			nds_ppu_pixel(&ppu, layer, x, y, color);
+			if(d[0x6] & 0x1) POKE2(d + 0x8, x + 1);
+			if(d[0x6] & 0x2) POKE2(d + 0xa, y + 1);
+		}
+	} else if(port == 0xf) {
+		Uint8 twobpp = !!(d[0xf] & 0x80);
+		Uint16 x = PEEK2(d + 0x8), y = PEEK2(d + 0xa), addr = PEEK2(d + 0xc);
+		Uint32 *layer = d[0xf] & 0x40 ? ppu.fg : ppu.bg;
+		Uint8 n = d[0x6] >> 4;
+		Uint8 dx = (d[0x6] & 0x01) << 3, dy = (d[0x6] & 0x02) << 2;
+		int flipx = (d[0xf] & 0x10), fx = flipx ? -1 : 1;
+		int flipy = (d[0xf] & 0x20), fy = flipy ? -1 : 1;
+		Uint16 dyx = dy * fx, dxy = dx * fy;
+		Uint16 len = (n + 1) << (3 + twobpp);
+		Uint16 addr_incr = (d[0x6] & 0x04) << (1 + twobpp);
+		if(addr > (0x10000 - len)) return;
+		nds_ppu_sprite(&ppu, layer, x, y, dyx, dxy, &ram[addr], addr_incr, n, d[0xf] & 0xf, flipx, flipy, twobpp);
+		addr += addr_incr * (n + 1);
+		POKE2(d + 0x8, x + dx * fx);
+		POKE2(d + 0xa, y + dy * fy);
+		POKE2(d + 0xc, addr);
+	}
+}
+
+static void nds_present(void) { nds_copyppu(&ppu); }
+
+static Uint8
+nds_pixel(int fg, int x, int y)
+{
+	Uint32 *layer = fg ? ppu.fg : ppu.bg;
+	return (layer[(y & 7) + ((x >> 3) + (y >> 3) * PPU_TILES_WIDTH) * 8] >> ((x & 7) << 2)) & 0xf;
+}
+
+static Renderer renderers[] = {
+	{"generic", generic_deo, generic_present, generic_pixel},
+	{"nds", nds_deo, nds_present, nds_pixel},
+	{"3ds", ctr_screen_deo, ctr_present, ctr_pixel}};
+
+#define RENDERERS (int)(sizeof(renderers) / sizeof(*renderers))
+
+/* streams */
+
+static ScreenWrite *stream;
+static int stream_length, stream_size;
+
+static void
+emit(Uint8 port, Uint8 value)
+{
+	if(stream_length == stream_size) {
+		stream_size = stream_size ? stream_size * 2 : 4096;
+		stream = realloc(stream, stream_size * sizeof(*stream));
+	}
+	stream[stream_length].port = port;
+	stream[stream_length++].value = value;
+}
+
+static void
+emit2(Uint8 port, Uint16 value)
+{
+	emit(port, value >> 8);
+	emit(port + 1, value);
+}
+
+static Uint16
+random_coord(int limit)
+{
+	switch(test_rand() % 8) {
+	case 0: return -(int)(test_rand() % 12);
+	case 1: return limit - test_rand() % 12;
+	case 2: return test_rand() % (limit / 8) * 8;
+	default: return test_rand() % (limit + 24);
+	}
+}
+
+/* Clears both layers, then draws fills, pixel runs and sprite strips at random. */
+static void
+random_stream(int ops)
+{
+	int i, k, n;
+	stream_length = 0;
+	emit2(0x8, 0), emit2(0xa, 0), emit(0xe, 0x80), emit(0xe, 0xc0);
+	for(i = 0; i < ops; i++) {
+		emit2(0x8, random_coord(WIDTH));
+		emit2(0xa, random_coord(HEIGHT));
+		switch(test_rand() % 8) {
+		case 0:
+			emit(0xe, 0x80 | (test_rand() & 0x73));
+			break;
+		case 1:
+		case 2:
+			emit(0x6, test_rand() % 4);
+			for(k = 0, n = 1 + test_rand() % 24; k < n; k++)
+				emit(0xe, test_rand() % 8 ? 0x41 : test_rand() & 0x43);
+			break;
+		default:
+			/* sprite data stays in range: the NDS skips sprites reading past the end of RAM */
+			emit(0x6, test_rand());
+			emit2(0xc, test_rand() % 0xe000);
+			for(k = 0, n = 1 + test_rand() % 3; k < n; k++)
+				emit(0xf, test_rand());
+		}
+	}
+}
+
+static int
+load_stream(char *path)
+{
+	FILE *f = fopen(path, "rb");
+	int c;
+	if(!f)
+		return 0;
+	stream_length = 0;
+	while((c = fgetc(f)) != EOF) {
+		int value = fgetc(f);
+		if(value == EOF)
+			break;
+		emit(c, value);
+	}
+	fclose(f);
+	return 1;
+}
+
+/* replay and compare */
+
+static void
+replay(void)
+{
+	int i, k, x, y, l;
+	for(k = 0; k < RENDERERS; k++) {
+		Renderer *r = &renderers[k];
+		double start = test_time();
+		for(i = 0; i < stream_length; i++) {
+			Uint8 port = stream[i].port & 0xf;
+			if(port < 0x6)
+				continue;
+			r->dev[port] = stream[i].value;
+			r->deo(r->dev, port);
+		}
+		r->draw_time += test_time() - start;
+		start = test_time();
+		r->present();
+		r->present_time += test_time() - start;
+	}
+	for(k = 1; k < RENDERERS; k++) {
+		Renderer *r = &renderers[k];
+		for(l = 0; l < 2; l++)
+			for(y = 0; y < HEIGHT; y++)
+				for(x = 0; x < WIDTH; x++)
+					if(r->pixel(l, x, y) != renderers[0].pixel(l, x, y))
+						r->diffs[l]++;
+		if(memcmp(r->dev + 0x6, renderers[0].dev + 0x6, 0xa))
+			r->dev_diffs++;
+	}
+}
+
+static long
+report(void)
+{
+	int k;
+	long total = 0;
+	printf("%-8s %12s %12s %10s %10s %10s\n", "", "draw us", "present us", "bg diff", "fg diff", "port diff");
+	for(k = 0; k < RENDERERS; k++) {
+		Renderer *r = &renderers[k];
+		printf("%-8s %12.0f %12.0f %10ld %10ld %10ld\n", r->name, r->draw_time * 1e6, r->present_time * 1e6,
+			r->diffs[0], r->diffs[1], r->dev_diffs);
+		total += r->diffs[0] + r->diffs[1] + r->dev_diffs;
+	}
+	return total;
+}
+
+/*
+A color 0 sprite clears the area it covers, as the reference varvara screen
+does (opaque = color % 5 || !color); colors 5, 10 and 15 leave pixel 0 alone.
+*/
+static void
+test_color0_opaque(void)
+{
+	int k, x, y;
+	Uint8 sprite[16] = {0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55};
+	memcpy(ram + 0xf000, sprite, sizeof(sprite));
+	stream_length = 0;
+	emit2(0x8, 0), emit2(0xa, 0), emit(0xe, 0x83);
+	emit(0x6, 0x00), emit2(0xc, 0xf000);
+	emit2(0x8, 16), emit2(0xa, 16), emit(0xf, 0x00);
+	emit2(0x8, 32), emit2(0xa, 16), emit(0xf, 0x05);
+	replay();
+	for(k = 0; k < RENDERERS; k++)
+		for(y = 16; y < 24; y++)
+			for(x = 0; x < 8; x++) {
+				Uint8 set = (sprite[y - 16] >> (7 - x)) & 1;
+				CHECK(renderers[k].pixel(0, 16 + x, y) == 0, "%s: color 0 sprite left %d at %d,%d",
+					renderers[k].name, renderers[k].pixel(0, 16 + x, y), 16 + x, y);
+				CHECK(renderers[k].pixel(0, 32 + x, y) == (set ? 1 : 3), "%s: color 5 sprite drew %d at %d,%d",
+					renderers[k].name, renderers[k].pixel(0, 32 + x, y), 32 + x, y);
+			}
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, k;
+	char *path = NULL;
+	if(!test_init(argc, argv))
+		return 0;
+	for(i = 1; i + 1 < argc; i++)
+		if(!strcmp(argv[i], "--stream"))
+			path = argv[i + 1];
+	if(!nds_vram_map() || !nds_initppu(&ppu)) {
+		fprintf(stderr, "cannot map VRAM at %08x\n", NDS_VRAM_A);
+		return 1;
+	}
+	for(i = 0; i < 0x10000; i++)
+		ram[i] = test_rand();
+	u.ram.dat = ram;
+	screen_resize(WIDTH, HEIGHT);
+	ctr_screen_init(&uxn_ctr_screen, WIDTH, HEIGHT);
+	if(path) {
+		if(!load_stream(path)) {
+			fprintf(stderr, "cannot read %s\n", path);
+			return 1;
+		}
+		replay();
+		return report() != 0;
+	}
+	if(test_bench) {
+		random_stream(200000);
+		replay();
+		report();
+		return 0;
+	}
+	test_color0_opaque();
+	for(i = 0; i < 50; i++) {
+		random_stream(500);
+		replay();
+	}
+	for(k = 1; k < RENDERERS; k++)
+		CHECK(!renderers[k].diffs[0] && !renderers[k].diffs[1] && !renderers[k].dev_diffs, "%s differs from generic", renderers[k].name);
+	if(test_failures)
+		report();
+	return test_exit("screen_diff");
+}
@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Sprite cases shared by the renderer tests, one per blit variant or edge
+case, with the per-pixel model they are checked against. Include after
+test.h, with WIDTH and HEIGHT defined and the renderer's blending table
+in scope.
+*/
+
+typedef struct {
+	char *name;
+	Uint8 color, flipx, flipy, twobpp;
+	int x, y;
+} SpriteCase;
+
+static SpriteCase sprite_cases[] = {
+	{"base: 1bpp, color 1, aligned", 0x1, 0, 0, 0, 64, 64},
+	{"2bpp", 0x1, 0, 0, 1, 64, 64},
+	{"color 5 (transparent 0)", 0x5, 0, 0, 0, 64, 64},
+	{"color 5, 2bpp", 0x5, 0, 0, 1, 64, 64},
+	{"flip x", 0x1, 1, 0, 0, 64, 64},
+	{"flip y", 0x1, 0, 1, 0, 64, 64},
+	{"flip x and y", 0x1, 1, 1, 0, 64, 64},
+	{"x not a multiple of 8", 0x1, 0, 0, 0, 67, 64},
+	{"y not a multiple of 8", 0x1, 0, 0, 0, 64, 67},
+	{"across 64 pixel tiles", 0x1, 0, 0, 0, 61, 59},
+	{"clipped left", 0x1, 0, 0, 0, -3, 64},
+	{"clipped right", 0x1, 0, 0, 0, WIDTH - 5, 64},
+	{"clipped bottom", 0x1, 0, 0, 0, 64, HEIGHT - 5},
+	{"hidden", 0x1, 0, 0, 0, -16, 64},
+	{NULL}};
+
+/* The sprite port as the varvara reference draws it, pixel by pixel, into one byte per pixel. */
+static void
+model_sprite(Uint8 *layer, int width, int height, Uint16 x0, Uint16 y0, Uint8 *sprite, Uint8 color, int flipx, int flipy, int twobpp)
+{
+	int v, h, opaque = blending[4][color];
+	for(v = 0; v < 8; v++) {
+		Uint16 c = sprite[v] | (twobpp ? sprite[v + 8] << 8 : 0);
+		Uint16 y = y0 + (flipy ? 7 - v : v);
+		for(h = 7; h >= 0; --h, c >>= 1) {
+			Uint8 ch = (c & 1) | ((c >> 7) & 2);
+			Uint16 x = x0 + (flipx ? 7 - h : h);
+			if((opaque || ch) && x < width && y < height)
+				layer[x + y * width] = blending[ch][color];
+		}
+	}
+}
+
+/* Times draw(case, sprite data) for each case, with the sprite data taken from ram. */
+static void
+bench_sprite_cases(char *renderer, void (*draw)(SpriteCase *c, Uint8 *sprite), Uint8 *ram)
+{
+	SpriteCase *c;
+	double warmup = test_time();
+	while(test_time() - warmup < 0.2)
+		draw(sprite_cases, ram);
+	for(c = sprite_cases; c->name; c++) {
+		long sprites = 0;
+		double start = test_time(), elapsed;
+		do {
+			int i;
+			for(i = 0; i < 1000; i++)
+				draw(c, ram + (i & 0xff) * 16);
+			sprites += i;
+		} while((elapsed = test_time() - start) < 0.2);
+		printf("%s sprite %-30s %7.2f Msprites/s\n", renderer, c->name, sprites / elapsed / 1e6);
+	}
+}
+
+/*
+Draws each case in all 16 colors and checks the layer against the model.
+read copies the layer drawn to into one byte per pixel, WIDTH by HEIGHT.
+*/
+static void
+test_sprite_cases(char *renderer, void (*draw)(SpriteCase *c, Uint8 *sprite), void (*read)(Uint8 *layer), Uint8 *ram)
+{
+	static Uint8 want[WIDTH * HEIGHT], got[WIDTH * HEIGHT];
+	SpriteCase *c, k;
+	int color, i;
+	for(c = sprite_cases; c->name; c++)
+		for(color = 0; color < 16; color++) {
+			Uint8 *sprite = ram + (test_rand() & 0xff) * 16;
+			k = *c;
+			k.color = color;
+			read(want);
+			model_sprite(want, WIDTH, HEIGHT, k.x, k.y, sprite, color, k.flipx, k.flipy, k.twobpp);
+			draw(&k, sprite);
+			read(got);
+			for(i = 0; i < WIDTH * HEIGHT && want[i] == got[i]; i++)
+				;
+			CHECK(i == WIDTH * HEIGHT, "%s: %s, color %x: pixel %d,%d is %d, not %d", renderer, c->name, color,
+				i % WIDTH, i / WIDTH, got[i], want[i]);
+		}
+}
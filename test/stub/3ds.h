@@ -0,0 +1,29 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Just enough of libctru for ctr_screen.c on the host: plain memory for the
+linear heap and textures, no-ops for the cache and the display transfer. */
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int16_t s16;
+typedef int32_t s32;
+
+#define linearAlloc malloc
+#define linearFree free
+#define GSPGPU_InvalidateDataCache(addr, size) ((void)(addr), (void)(size))
+#define GSPGPU_FlushDataCache(addr, size) ((void)(addr), (void)(size))
+
+#define GX_BUFFER_DIM(w, h) ((h) << 16 | (w))
+#define GX_TRANSFER_FLIP_VERT(x) 0
+#define GX_TRANSFER_OUT_TILED(x) 0
+#define GX_TRANSFER_RAW_COPY(x) 0
+#define GX_TRANSFER_SCALING(x) 0
+#define GX_TRANSFER_IN_FORMAT(x) 0
+#define GX_TRANSFER_OUT_FORMAT(x) 0
+#define GX_TRANSFER_SCALE_NO 0
+#define GX_TRANSFER_FMT_RGBA8 0
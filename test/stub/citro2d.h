@@ -0,0 +1,8 @@
+#pragma once
+#include <citro3d.h>
+#include <tex3ds.h>
+
+typedef struct {
+	C3D_Tex *tex;
+	const Tex3DS_SubTexture *subtex;
+} C2D_Image;
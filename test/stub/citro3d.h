@@ -0,0 +1,23 @@
+#pragma once
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct {
+	void *data;
+} C3D_Tex;
+
+#define GPU_RGBA8 0
+#define C3D_SyncDisplayTransfer(src, src_dim, dst, dst_dim, flags) ((void)(src), (void)(src_dim), (void)(dst), (void)(dst_dim))
+
+static inline bool
+C3D_TexInitVRAM(C3D_Tex *tex, int width, int height, int format)
+{
+	return (tex->data = calloc(width * height, 4)) != NULL;
+}
+
+static inline void
+C3D_TexDelete(C3D_Tex *tex)
+{
+	free(tex->data);
+	tex->data = NULL;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Just enough of libnds for nds_ppu.c on the host. The main engine's VRAM
+bank A is expected at its hardware address, 0x06000000, where the test maps
+it: nds_copyppu finds a layer's front buffer by clearing an address bit. */
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int16_t s16;
+typedef int32_t s32;
+
+#define DTCM_DATA
+#define DTCM_BSS
+
+#define NDS_VRAM_A 0x06000000
+#define NDS_VRAM_A_SIZE 0x20000
+
+#define RGB15(r, g, b) ((r) | (g) << 5 | (b) << 10)
+#define BG_GFX ((u16 *)(uintptr_t)NDS_VRAM_A)
+#define BG_TILE_RAM(base) ((u16 *)(uintptr_t)(NDS_VRAM_A + (base) * 0x4000))
+
+#define DISPLAY_BG0_ACTIVE (1 << 8)
+#define DISPLAY_BG1_ACTIVE (1 << 9)
+#define MODE_0_2D 0x10000
+#define VRAM_A_MAIN_BG 0x81
+#define BG_32x32 0
+#define BG_COLOR_16 0
+#define BG_PRIORITY_2 2
+#define BG_PRIORITY_3 3
+#define BG_TILE_BASE(base) ((base) << 2)
+#define BG_MAP_BASE(base) ((base) << 8)
+
+static __attribute__((unused)) u16 BG_PALETTE[256];
+static __attribute__((unused)) u16 REG_BG0CNT, REG_BG1CNT, REG_BG0HOFS, REG_BG0VOFS, REG_BG1HOFS, REG_BG1VOFS;
+
+#define videoSetMode(mode) ((void)(mode))
+#define vramSetBankA(mode) ((void)(mode))
+
+/* Maps bank A where the hardware has it; returns 0 if that is not possible. */
+static inline int
+nds_vram_map(void)
+{
+	void *vram = mmap((void *)(uintptr_t)NDS_VRAM_A, NDS_VRAM_A_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	return vram == (void *)(uintptr_t)NDS_VRAM_A;
+}
+
+static inline void
+dmaFillWords(u32 value, void *dest, u32 size)
+{
+	u32 *d = dest;
+	for(size >>= 2; size; size--)
+		*d++ = value;
+}
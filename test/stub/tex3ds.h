@@ -0,0 +1,5 @@
+#pragma once
+typedef struct {
+	unsigned short width, height;
+	float left, top, right, bottom;
+} Tex3DS_SubTexture;
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+Copyright (c) 2023 Adrian "asie" Siekierka
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/*
+Shared by the host tests under test/, see Makefile.host. Each test is one
+program which includes the code it covers, so that static functions can be
+called directly. Run without arguments it checks and returns the number of
+failures; run with --bench it prints timings instead.
+*/
+
+static int test_failures, test_bench;
+static unsigned long long test_seed = 1;
+
+#define CHECK(cond, ...) \
+	do { \
+		if(!(cond)) { \
+			if(test_failures++ < 20) { \
+				fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+				fprintf(stderr, __VA_ARGS__); \
+				fputc('\n', stderr); \
+			} \
+		} \
+	} while(0)
+
+static unsigned int
+test_rand(void)
+{
+	test_seed = test_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return test_seed >> 33;
+}
+
+static double
+test_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns 0 when the binary should not run here: built for an instruction set (TEST_ISA) the CPU lacks. */
+static int
+test_init(int argc, char **argv)
+{
+	int i;
+	for(i = 1; i < argc; i++)
+		if(!strcmp(argv[i], "--bench"))
+			test_bench = 1;
+#ifdef TEST_ISA
+	__builtin_cpu_init();
+	if(!__builtin_cpu_supports(TEST_ISA)) {
+		printf("%s: skipped, no %s\n", argv[0], TEST_ISA);
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+static int
+test_exit(char *name)
+{
+	if(!test_bench)
+		printf("%s: %s (%d failures)\n", name, test_failures ? "FAIL" : "ok", test_failures);
+	return test_failures != 0;
+}